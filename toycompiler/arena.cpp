@@ -0,0 +1,79 @@
+#include "arena.h"
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+
+void Arena::NewBlock(size_t minSize) {
+  size_t Size = minSize > BLOCK_SIZE ? minSize : BLOCK_SIZE;
+  char *Block = static_cast<char *>(std::malloc(Size));
+  if (Block == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  Blocks.push_back(Block);
+  Current = Block;
+  End = Block + Size;
+  BytesReserved += Size;
+}
+
+void *Arena::Allocate(size_t size, size_t align) {
+  if (PerObject) {
+    // operator new выравнивает память для любого базового типа.
+    void *Object = ::operator new(size);
+    Blocks.push_back(static_cast<char *>(Object));
+    BytesAllocated += size;
+    BytesReserved += size;
+    return Object;
+  }
+
+  uintptr_t Ptr = reinterpret_cast<uintptr_t>(Current);
+  uintptr_t Aligned = (Ptr + align - 1) & ~(uintptr_t)(align - 1);
+
+  if (Current == nullptr || Aligned + size > reinterpret_cast<uintptr_t>(End)) {
+    // В текущем блоке места не осталось - заводим новый.
+    // Начало блока от malloc выровнено для любого базового типа.
+    NewBlock(size + align);
+    Ptr = reinterpret_cast<uintptr_t>(Current);
+    Aligned = (Ptr + align - 1) & ~(uintptr_t)(align - 1);
+  }
+
+  Current = reinterpret_cast<char *>(Aligned + size);
+  BytesAllocated += size;
+  return reinterpret_cast<void *>(Aligned);
+}
+
+void Arena::Reset() {
+  // Объекты уничтожаются в порядке, обратном порядку создания.
+  for (auto it = Destructors.rbegin(); it != Destructors.rend(); ++it) {
+    it->Destroy(it->Object);
+  }
+
+  for (auto block : Blocks) {
+    if (PerObject) {
+      ::operator delete(block);
+    } else {
+      std::free(block);
+    }
+  }
+
+  Destructors.clear();
+  Blocks.clear();
+  Current = End = nullptr;
+  BytesAllocated = BytesReserved = 0;
+}
+
+void Arena::Adopt(Arena &other) {
+  assert(PerObject == other.PerObject);
+  Blocks.insert(Blocks.end(), other.Blocks.begin(), other.Blocks.end());
+  Destructors.insert(Destructors.end(), other.Destructors.begin(),
+                     other.Destructors.end());
+  BytesAllocated += other.BytesAllocated;
+  BytesReserved += other.BytesReserved;
+
+  other.Blocks.clear();
+  other.Destructors.clear();
+  other.Current = other.End = nullptr;
+  other.BytesAllocated = other.BytesReserved = 0;
+}
+
+Arena::~Arena() { Reset(); }
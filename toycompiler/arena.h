@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Арена (bump-аллокатор) для узлов AST.
+//
+// Память выделяется крупными блоками, а объекты размещаются в них
+// подряд простым сдвигом указателя. Арена владеет всеми созданными
+// в ней объектами и освобождает их разом при собственном уничтожении,
+// поэтому указатели между узлами дерева остаются невладеющими.
+//
+// Арена с perObject выделяет каждый объект отдельным operator new,
+// как до появления арены. Она нужна только для сравнения в бенчмарке
+// (bench/frontbench -n).
+class Arena {
+  // Запись о деструкторе объекта, который нужно вызвать
+  // при уничтожении арены.
+  struct Destructor {
+    void (*Destroy)(void *);
+    void *Object;
+  };
+
+  std::vector<char *> Blocks;
+  std::vector<Destructor> Destructors;
+  char *Current;
+  char *End;
+  size_t BytesAllocated;
+  size_t BytesReserved;
+  bool PerObject;
+
+  template <typename T> static void DestroyObject(void *object) {
+    static_cast<T *>(object)->~T();
+  }
+
+  void NewBlock(size_t minSize);
+
+public:
+  // Размер блока по умолчанию.
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  explicit Arena(bool perObject = false)
+      : Current(nullptr), End(nullptr), BytesAllocated(0), BytesReserved(0),
+        PerObject(perObject) {}
+
+  ~Arena();
+
+  // Уничтожение всех объектов и освобождение памяти. После сброса
+  // арену можно использовать заново, например для следующего оператора
+  // при потоковой компиляции.
+  void Reset();
+
+  // Передача всех объектов другой арены во владение этой
+  // (например, деревьев, разобранных в отдельных потоках).
+  // Другая арена остается пустой.
+  void Adopt(Arena &other);
+
+  // Выделение неинициализированной памяти с заданным выравниванием.
+  void *Allocate(size_t size, size_t align);
+
+  // Создание объекта в арене. Если у типа есть нетривиальный
+  // деструктор, он будет вызван при уничтожении арены.
+  template <typename T, typename... Args> T *Create(Args &&... args) {
+    void *Mem = Allocate(sizeof(T), alignof(T));
+    T *Obj = new (Mem) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+      Destructors.push_back({&DestroyObject<T>, Obj});
+    }
+
+    return Obj;
+  }
+
+  // Копирование массива объектов с тривиальным деструктором в арену.
+  template <typename T> T *CopyArray(const T *data, size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Array elements are never destroyed");
+    if (count == 0) {
+      return nullptr;
+    }
+
+    T *Array = static_cast<T *>(Allocate(sizeof(T) * count, alignof(T)));
+    std::uninitialized_copy(data, data + count, Array);
+    return Array;
+  }
+
+  // Статистика использования памяти.
+  size_t GetBytesAllocated() const { return BytesAllocated; }
+  size_t GetBytesReserved() const { return BytesReserved; }
+  size_t GetObjectCount() const { return Destructors.size(); }
+
+private:
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+};
@@ -49,10 +49,24 @@ void ConstNode::Format(std::ostream &out) { out << Val; }
 
 void VarNode::Format(std::ostream &out) { out << Name; }
 
-void BinaryNode::Format(std::ostream &out) {
-  LHS->Format(out);
-  PrintBinaryOp(Op, out);
-  RHS->Format(out);
+void SumNode::Format(std::ostream &out) {
+  for (size_t i = 0; i < NumTerms; ++i) {
+    if (i > 0) {
+      PrintBinaryOp(Terms[i].Op, out);
+    } else if (Terms[i].Op == SUB) {
+      out << "-";
+    }
+
+    Terms[i].Expr->Format(out);
+  }
+
+  if (NumTerms == 0) {
+    out << Constant;
+  } else if (Constant > 0) {
+    out << " + " << Constant;
+  } else if (Constant < 0) {
+    out << " - " << -(long long)Constant;
+  }
 }
 
 // Печать операторов
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "generator.h"
+#include "symbols.h"
 #include <llvm/IR/IRBuilder.h>
+#include <cstdint>
 #include <string>
-#include <set>
+#include <vector>
 
 // Бинарные операторы
 enum BinaryOp {
@@ -18,13 +20,44 @@ enum CompareOp {
   POSITIVE  // Значение больше нуля
 };
 
+class FoldState;
+class BytecodeBuilder;
+class BatchState;
+class FlatAstBuilder;
+class RangeState;
+struct LinearForm;
+
+// Узлы дерева создаются в арене (см. arena.h), которая ими и владеет,
+// поэтому указатели на дочерние узлы ниже - невладеющие.
+
 // Выражение (абстрактный базовый класс).
 class ExprNode {
 public:
   virtual ~ExprNode() {}
   virtual llvm::Value *Generate(GeneratorState *) = 0;
-  virtual std::set<std::string> GetVariables() = 0;
   virtual void Format(std::ostream &) = 0;
+
+  // Свертка констант (см. fold.h). Возвращает узел, которым следует
+  // заменить данный.
+  virtual ExprNode *Fold(FoldState &) = 0;
+
+  // Значение выражения, если оно известно при компиляции.
+  virtual bool GetConstValue(int &) const { return false; }
+
+  // Трансляция в байт-код (см. bytecode.h): значение выражения
+  // помещается в регистр dst.
+  virtual void Lower(BytecodeBuilder &, unsigned dst) = 0;
+
+  // Замена номеров переменных: id -> ids[id] (см. parallelparse.h).
+  virtual void RenumberVariables(const std::vector<unsigned> &ids) = 0;
+
+  // Добавление выражения (со знаком минус при negate) к строящемуся
+  // выражению плоского представления (см. flatast.h).
+  virtual void Flatten(FlatAstBuilder &, bool negate) = 0;
+
+  // Добавление выражения (со знаком минус при negate) к линейной
+  // форме для анализа диапазонов (см. range.h).
+  virtual void Linearize(LinearForm &, bool negate) = 0;
 };
 
 // Выражение с ошибкой.
@@ -35,12 +68,18 @@ public:
 
   virtual llvm::Value *Generate(GeneratorState *) { return nullptr; }
 
-  virtual std::set<std::string> GetVariables() {
-    return std::set<std::string>();
-  }
-
   virtual void Format(std::ostream &out);
 
+  virtual ExprNode *Fold(FoldState &) { return this; }
+
+  virtual void Lower(BytecodeBuilder &, unsigned) {}
+
+  virtual void RenumberVariables(const std::vector<unsigned> &) {}
+
+  virtual void Flatten(FlatAstBuilder &, bool) {}
+
+  virtual void Linearize(LinearForm &, bool) {}
+
   // Публично доступное сообщение об ошибке.
   std::string Message;
 };
@@ -52,33 +91,63 @@ class ConstNode : public ExprNode {
 public:
   ConstNode(int val) : Val(val) {}
   virtual llvm::Value *Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &os);
+  virtual ExprNode *Fold(FoldState &) { return this; }
+  virtual void Lower(BytecodeBuilder &, unsigned dst);
+  virtual void RenumberVariables(const std::vector<unsigned> &) {}
+  virtual void Flatten(FlatAstBuilder &, bool negate);
+  virtual void Linearize(LinearForm &, bool negate);
+
+  virtual bool GetConstValue(int &val) const {
+    val = Val;
+    return true;
+  }
 };
 
-// Переменная
+// Переменная.
+// Хранит номер переменной из VariableTable и ссылку на ее имя там же.
 class VarNode : public ExprNode {
-  std::string Name;
+  unsigned Id;
+  const std::string &Name;
 
 public:
-  VarNode(const std::string &name) : Name(name) {}
+  VarNode(unsigned id, const std::string &name) : Id(id), Name(name) {}
+  unsigned GetId() const { return Id; }
   virtual llvm::Value *Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &os);
+  virtual ExprNode *Fold(FoldState &);
+  virtual void Lower(BytecodeBuilder &, unsigned dst);
+  virtual void RenumberVariables(const std::vector<unsigned> &ids);
+  virtual void Flatten(FlatAstBuilder &, bool negate);
+  virtual void Linearize(LinearForm &, bool negate);
 };
 
-// Применение бинарной операции
-class BinaryNode : public ExprNode {
-  BinaryOp Op;
-  ExprNode *LHS;
-  ExprNode *RHS;
+// Сумма слагаемых со знаками и свободного члена: c + t1 - t2 + ...
+// Длинные выражения хранятся плоским массивом слагаемых, поэтому
+// их обход не углубляет стек. Константы складываются при разборе
+// в свободный член.
+class SumNode : public ExprNode {
+public:
+  struct Term {
+    BinaryOp Op;
+    ExprNode *Expr;
+  };
+
+private:
+  int Constant;
+  const Term *Terms;
+  size_t NumTerms;
 
 public:
-  BinaryNode(BinaryOp op, ExprNode *lhs, ExprNode *rhs)
-      : Op(op), LHS(lhs), RHS(rhs) {}
+  SumNode(int constant, const Term *terms, size_t numTerms)
+      : Constant(constant), Terms(terms), NumTerms(numTerms) {}
   virtual llvm::Value *Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &os);
+  virtual ExprNode *Fold(FoldState &);
+  virtual void Lower(BytecodeBuilder &, unsigned dst);
+  virtual void RenumberVariables(const std::vector<unsigned> &ids);
+  virtual void Flatten(FlatAstBuilder &, bool negate);
+  virtual void Linearize(LinearForm &, bool negate);
 };
 
 // Оператор (абстрактный базовый класс)
@@ -91,8 +160,29 @@ public:
   virtual bool IsValid() const { return true; }
 
   virtual void Generate(GeneratorState *) = 0;
-  virtual std::set<std::string> GetVariables() = 0;
   virtual void Format(std::ostream &out, int indent) = 0;
+
+  // Свертка констант (см. fold.h). Возвращает узел, которым следует
+  // заменить данный.
+  virtual StmtNode *Fold(FoldState &) = 0;
+
+  // Трансляция в байт-код (см. bytecode.h).
+  virtual void Lower(BytecodeBuilder &) = 0;
+
+  // Генерация без ветвлений для пакетной точки входа (см. batch.h):
+  // оператор действует только на дорожках, где mask истинна
+  // (mask == nullptr - на всех).
+  virtual void GenerateBatch(BatchState &, llvm::Value *mask) = 0;
+
+  // Замена номеров переменных: id -> ids[id] (см. parallelparse.h).
+  virtual void RenumberVariables(const std::vector<unsigned> &ids) = 0;
+
+  // Заполнение места slot плоского представления (см. flatast.h).
+  virtual void Flatten(FlatAstBuilder &, uint32_t slot) = 0;
+
+  // Удаление ветвей с предрешенным условием по диапазонам значений
+  // (см. range.h). Возвращает узел, которым следует заменить данный.
+  virtual StmtNode *Prune(RangeState &) = 0;
 };
 
 // Оператор с ошибкой.
@@ -106,12 +196,21 @@ public:
 
   virtual void Generate(GeneratorState *) {}
 
-  virtual std::set<std::string> GetVariables() {
-    return std::set<std::string>();
-  }
-
   virtual void Format(std::ostream &out, int indent);
 
+  virtual StmtNode *Fold(FoldState &) { return this; }
+
+  virtual void Lower(BytecodeBuilder &) {}
+
+  virtual void GenerateBatch(BatchState &, llvm::Value *) {}
+
+  virtual void RenumberVariables(const std::vector<unsigned> &) {}
+
+  // Недействительная программа в плоское представление не переводится.
+  virtual void Flatten(FlatAstBuilder &, uint32_t) {}
+
+  virtual StmtNode *Prune(RangeState &) { return this; }
+
   // Публично доступное сообщение об ошибке.
   std::string Message;
 };
@@ -124,22 +223,36 @@ public:
   SeqNode() {}
 
   void Add(StmtNode *stmt) { Statements.push_back(stmt); }
+  bool IsEmpty() const { return Statements.empty(); }
+  const std::vector<StmtNode *> &GetStatements() const { return Statements; }
 
   virtual void Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &out, int indent);
+  virtual StmtNode *Fold(FoldState &);
+  virtual void Lower(BytecodeBuilder &);
+  virtual void GenerateBatch(BatchState &, llvm::Value *mask);
+  virtual void RenumberVariables(const std::vector<unsigned> &ids);
+  virtual void Flatten(FlatAstBuilder &, uint32_t slot);
+  virtual StmtNode *Prune(RangeState &);
 };
 
 // Оператор присваивания
 class AssignNode : public StmtNode {
-  std::string Name;
+  unsigned Id;
+  const std::string &Name;
   ExprNode *RHS;
 
 public:
-  AssignNode(const std::string &name, ExprNode *rhs) : Name(name), RHS(rhs) {}
+  AssignNode(unsigned id, const std::string &name, ExprNode *rhs)
+      : Id(id), Name(name), RHS(rhs) {}
   virtual void Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &out, int indent);
+  virtual StmtNode *Fold(FoldState &);
+  virtual void Lower(BytecodeBuilder &);
+  virtual void GenerateBatch(BatchState &, llvm::Value *mask);
+  virtual void RenumberVariables(const std::vector<unsigned> &ids);
+  virtual void Flatten(FlatAstBuilder &, uint32_t slot);
+  virtual StmtNode *Prune(RangeState &);
 };
 
 // Условный оператор
@@ -154,8 +267,13 @@ public:
       : Op(op), Cond(cond), Then(thenBlock), Else(elseBlock) {}
 
   virtual void Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &out, int indent);
+  virtual StmtNode *Fold(FoldState &);
+  virtual void Lower(BytecodeBuilder &);
+  virtual void GenerateBatch(BatchState &, llvm::Value *mask);
+  virtual void RenumberVariables(const std::vector<unsigned> &ids);
+  virtual void Flatten(FlatAstBuilder &, uint32_t slot);
+  virtual StmtNode *Prune(RangeState &);
 };
 
 // Оператор печати
@@ -165,17 +283,28 @@ class PrintNode : public StmtNode {
 public:
   PrintNode(ExprNode *rhs) : RHS(rhs) {}
   virtual void Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &out, int indent);
+  virtual StmtNode *Fold(FoldState &);
+  virtual void Lower(BytecodeBuilder &);
+  virtual void GenerateBatch(BatchState &, llvm::Value *mask);
+  virtual void RenumberVariables(const std::vector<unsigned> &ids);
+  virtual void Flatten(FlatAstBuilder &, uint32_t slot);
+  virtual StmtNode *Prune(RangeState &);
 };
 
 // Оператор ввода
 class InputNode : public StmtNode {
-  std::string Name;
+  unsigned Id;
+  const std::string &Name;
 
 public:
-  InputNode(const std::string &name) : Name(name) {}
+  InputNode(unsigned id, const std::string &name) : Id(id), Name(name) {}
   virtual void Generate(GeneratorState *);
-  virtual std::set<std::string> GetVariables();
   virtual void Format(std::ostream &out, int indent);
+  virtual StmtNode *Fold(FoldState &);
+  virtual void Lower(BytecodeBuilder &);
+  virtual void GenerateBatch(BatchState &, llvm::Value *mask);
+  virtual void RenumberVariables(const std::vector<unsigned> &ids);
+  virtual void Flatten(FlatAstBuilder &, uint32_t slot);
+  virtual StmtNode *Prune(RangeState &);
 };
@@ -0,0 +1,215 @@
+#include "batch.h"
+#include "ast.h"
+#include <algorithm>
+
+// Состояние пакетной генерации
+// =====================================================================
+
+Value *BatchState::Slot(Value *base, Value *pos, Value *mask) {
+  IRBuilder<> *B = Gen.Builder;
+
+  // На выключенной дорожке динамический номер может указывать за конец
+  // ее значений; такая дорожка обращается к значению 0. Константный
+  // номер всегда меньше наибольшего числа значений.
+  if (mask != nullptr && !isa<Constant>(pos)) {
+    pos = B->CreateSelect(mask, pos, B->getInt32(0));
+  }
+
+  Value *Index = B->CreateAdd(
+      B->CreateMul(B->CreateZExt(pos, B->getInt64Ty()), Count), Lane);
+  return B->CreateGEP(base, Index);
+}
+
+Value *BatchState::Advance(Value *pos, Value *mask) {
+  IRBuilder<> *B = Gen.Builder;
+  if (mask == nullptr) {
+    return B->CreateAdd(pos, B->getInt32(1));
+  }
+
+  return B->CreateAdd(pos, B->CreateZExt(mask, B->getInt32Ty()));
+}
+
+Value *BatchState::And(Value *mask, Value *cond) {
+  return mask != nullptr ? Gen.Builder->CreateAnd(mask, cond) : cond;
+}
+
+// Генерация операторов под маской
+// =====================================================================
+
+void SeqNode::GenerateBatch(BatchState &state, Value *mask) {
+  for (auto stmt : Statements) {
+    stmt->GenerateBatch(state, mask);
+  }
+}
+
+void AssignNode::GenerateBatch(BatchState &state, Value *mask) {
+  IRBuilder<> *B = state.Gen.Builder;
+  AllocaInst *Var = state.Gen.GetVar(Id);
+  Value *V = RHS->Generate(&state.Gen);
+  if (mask != nullptr) {
+    V = B->CreateSelect(mask, V, B->CreateLoad(Var));
+  }
+
+  B->CreateStore(V, Var);
+}
+
+void IfNode::GenerateBatch(BatchState &state, Value *mask) {
+  IRBuilder<> *B = state.Gen.Builder;
+  Value *Arg = Cond->Generate(&state.Gen);
+  Value *Zero = B->getInt32(0);
+
+  Value *C;
+  if (Op == NEGATIVE) {
+    C = B->CreateICmpSLT(Arg, Zero);
+  } else if (Op == ZERO) {
+    C = B->CreateICmpEQ(Arg, Zero);
+  } else {
+    C = B->CreateICmpSGT(Arg, Zero);
+  }
+
+  // Обе ветви генерируются подряд. Дорожка исполняет только одну из
+  // них, поэтому число значений ввода-вывода - максимум по ветвям.
+  unsigned Inputs = state.MaxInputs;
+  unsigned Outputs = state.MaxOutputs;
+
+  Then->GenerateBatch(state, state.And(mask, C));
+  unsigned ThenInputs = state.MaxInputs;
+  unsigned ThenOutputs = state.MaxOutputs;
+
+  state.MaxInputs = Inputs;
+  state.MaxOutputs = Outputs;
+  if (Else != nullptr) {
+    Else->GenerateBatch(state, state.And(mask, B->CreateNot(C)));
+  }
+
+  state.MaxInputs = std::max(state.MaxInputs, ThenInputs);
+  state.MaxOutputs = std::max(state.MaxOutputs, ThenOutputs);
+}
+
+void PrintNode::GenerateBatch(BatchState &state, Value *mask) {
+  IRBuilder<> *B = state.Gen.Builder;
+  Value *V = RHS->Generate(&state.Gen);
+  Value *Ptr = state.Slot(state.Outputs, state.OutputPos, mask);
+
+  // Выключенная дорожка записывает на место то, что там уже было.
+  if (mask != nullptr) {
+    V = B->CreateSelect(mask, V, B->CreateLoad(Ptr));
+  }
+
+  B->CreateStore(V, Ptr);
+  state.OutputPos = state.Advance(state.OutputPos, mask);
+  ++state.MaxOutputs;
+}
+
+void InputNode::GenerateBatch(BatchState &state, Value *mask) {
+  IRBuilder<> *B = state.Gen.Builder;
+  AllocaInst *Var = state.Gen.GetVar(Id);
+  Value *V = B->CreateLoad(state.Slot(state.Inputs, state.InputPos, mask));
+  if (mask != nullptr) {
+    V = B->CreateSelect(mask, V, B->CreateLoad(Var));
+  }
+
+  B->CreateStore(V, Var);
+  state.InputPos = state.Advance(state.InputPos, mask);
+  ++state.MaxInputs;
+}
+
+// Точка входа
+// =====================================================================
+
+// Функция без аргументов, возвращающая константу.
+static void CreateConstFunction(GeneratorState &Gen, const char *name,
+                                unsigned value) {
+  LLVMContext &Context = Gen.GetContext();
+  Function *F = Function::Create(
+      FunctionType::get(Type::getInt32Ty(Context), false),
+      Function::ExternalLinkage, name, Gen.GetMainModule());
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", F));
+  B.CreateRet(B.getInt32(value));
+}
+
+void GenerateBatchEntry(GeneratorState &Gen, StmtNode *Prog,
+                        const VariableTable &Vars) {
+  LLVMContext &Context = Gen.GetContext();
+  IRBuilder<> *B = Gen.Builder;
+
+  // Генератор переключается на новую функцию и потом возвращается.
+  BasicBlock *Resume = B->GetInsertBlock();
+  Function *SavedCurrent = Gen.Current;
+  Value *SavedFrame = Gen.Frame;
+  const VariableTable *SavedSymbols = Gen.Symbols;
+  std::vector<AllocaInst *> SavedVariables;
+  SavedVariables.swap(Gen.Variables);
+
+  // Дорожки работают с ячейками и в режиме DirectSSA: иначе выражения
+  // брали бы текущие значения переменных main, то есть инструкции
+  // другой функции.
+  bool SavedDirectSSA = Gen.DirectSSA;
+  Gen.DirectSSA = false;
+
+  // void toy_batch(const i32 *inputs, i32 *outputs, i32 *counts, i64 count)
+  Type *IntPtr = Type::getInt32PtrTy(Context);
+  std::vector<Type *> Params(3, IntPtr);
+  Params.push_back(Type::getInt64Ty(Context));
+  Function *Batch = Function::Create(
+      FunctionType::get(Type::getVoidTy(Context), Params, false),
+      Function::ExternalLinkage, "toy_batch", Gen.GetMainModule());
+  for (unsigned i = 1; i <= 3; ++i) {
+    Batch->setDoesNotAlias(i);
+    Batch->setDoesNotCapture(i);
+  }
+
+  Function::arg_iterator Arg = Batch->arg_begin();
+  Value *Inputs = Arg++;
+  Value *Outputs = Arg++;
+  Value *Counts = Arg++;
+  Value *Count = Arg;
+
+  Gen.Current = Batch;
+  Gen.Frame = nullptr;
+  Gen.AddVariablesLazily(Vars);
+
+  BasicBlock *Entry = BasicBlock::Create(Context, "entry", Batch);
+  BasicBlock *Header = BasicBlock::Create(Context, "lanes", Batch);
+  BasicBlock *Body = BasicBlock::Create(Context, "lane", Batch);
+  BasicBlock *Exit = BasicBlock::Create(Context, "exit", Batch);
+
+  B->SetInsertPoint(Entry);
+  B->CreateBr(Header);
+
+  B->SetInsertPoint(Header);
+  PHINode *Lane = B->CreatePHI(Type::getInt64Ty(Context), 2, "i");
+  Lane->addIncoming(B->getInt64(0), Entry);
+  B->CreateCondBr(B->CreateICmpSLT(Lane, Count), Body, Exit);
+
+  B->SetInsertPoint(Body);
+  BatchState State(Gen, Inputs, Outputs, Count, Lane);
+  Prog->GenerateBatch(State, nullptr);
+  B->CreateStore(State.OutputPos, B->CreateGEP(Counts, Lane));
+  Lane->addIncoming(B->CreateAdd(Lane, B->getInt64(1)), B->GetInsertBlock());
+  B->CreateBr(Header);
+
+  // Дорожки независимы: в начале каждой переменные обнуляются, иначе
+  // значения переходили бы между итерациями и мешали векторизации.
+  IRBuilder<> Init(Body, Body->begin());
+  for (auto Var : Gen.Variables) {
+    if (Var != nullptr) {
+      Init.CreateStore(Init.getInt32(0), Var);
+    }
+  }
+
+  B->SetInsertPoint(Exit);
+  B->CreateRetVoid();
+
+  CreateConstFunction(Gen, "toy_batch_inputs", State.MaxInputs);
+  CreateConstFunction(Gen, "toy_batch_outputs", State.MaxOutputs);
+
+  Gen.Current = SavedCurrent;
+  Gen.Frame = SavedFrame;
+  Gen.Symbols = SavedSymbols;
+  Gen.Variables.swap(SavedVariables);
+  Gen.DirectSSA = SavedDirectSSA;
+  if (Resume != nullptr) {
+    B->SetInsertPoint(Resume);
+  }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "generator.h"
+
+class StmtNode;
+
+// Пакетная точка входа: программа исполняется сразу для многих
+// независимых наборов входных данных (дорожек), см. toybatch.h.
+//
+// Тело программы генерируется внутри цикла по дорожкам без ветвлений:
+// ветви условного оператора исполняются обе, а присваивания, ввод и
+// вывод в них выполняются под маской (через select). Такой цикл
+// векторизуется оптимизатором по дорожкам.
+class BatchState {
+public:
+  BatchState(GeneratorState &gen, Value *inputs, Value *outputs, Value *count,
+             Value *lane)
+      : Gen(gen), Inputs(inputs), Outputs(outputs), Count(count), Lane(lane),
+        InputPos(nullptr), OutputPos(nullptr), MaxInputs(0), MaxOutputs(0) {
+    InputPos = OutputPos = Gen.Builder->getInt32(0);
+  }
+
+  GeneratorState &Gen;
+
+  // Аргументы toy_batch и номер текущей дорожки (i64).
+  Value *Inputs;
+  Value *Outputs;
+  Value *Count;
+  Value *Lane;
+
+  // Номера очередного вводимого и выводимого значения дорожки (i32).
+  // Пока ввод и вывод не встречались под условием, номера остаются
+  // константами, и обращения к массивам идут подряд по дорожкам.
+  Value *InputPos;
+  Value *OutputPos;
+
+  // Наибольшее число вводимых и выводимых значений по всем путям.
+  unsigned MaxInputs;
+  unsigned MaxOutputs;
+
+  // Адрес значения pos текущей дорожки в массиве base.
+  Value *Slot(Value *base, Value *pos, Value *mask);
+
+  // Переход к следующему значению на дорожках, где mask истинна.
+  Value *Advance(Value *pos, Value *mask);
+
+  // Маска вложенного условия (mask == nullptr - все дорожки).
+  Value *And(Value *mask, Value *cond);
+};
+
+// Генерация toy_batch, toy_batch_inputs и toy_batch_outputs в модуле
+// генератора. Текущая функция и переменные генератора не меняются.
+void GenerateBatchEntry(GeneratorState &Gen, StmtNode *Prog,
+                        const VariableTable &Vars);
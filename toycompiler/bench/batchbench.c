@@ -0,0 +1,133 @@
+// Сравнение пакетной точки входа (toy_batch) с обычным исполняемым
+// файлом той же программы, запускаемым отдельно для каждого набора
+// входных данных.
+//
+// Запуск: ./batchbench <scalar executable> [lanes] [processes]
+// Результаты печатаются в stderr.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../toybatch.h"
+
+static double Now(void) {
+  struct timespec Time;
+  clock_gettime(CLOCK_MONOTONIC, &Time);
+  return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+// Дописывание к строке command размера size, в которой уже length
+// символов. Возвращает 0, если строка не поместилась целиком.
+static int Append(char *command, size_t size, size_t *length,
+                  const char *format, ...) {
+  va_list Args;
+  va_start(Args, format);
+  int Written = vsnprintf(command + *length, size - *length, format, Args);
+  va_end(Args);
+
+  if (Written < 0 || (size_t)Written >= size - *length) {
+    return 0;
+  }
+
+  *length += (size_t)Written;
+  return 1;
+}
+
+// Исполнение программы для дорожки lane отдельным процессом;
+// возвращает 0, если вывод совпал с результатом toy_batch.
+static int RunScalar(const char *program, const int32_t *inputs,
+                     const int32_t *outputs, const int32_t *counts,
+                     int64_t lanes, int64_t lane) {
+  int32_t NumInputs = toy_batch_inputs();
+  char Command[4096];
+  size_t Length = 0;
+  int Fits = Append(Command, sizeof(Command), &Length, "printf '%%s\\n'");
+  for (int32_t k = 0; Fits && k < NumInputs; ++k) {
+    Fits = Append(Command, sizeof(Command), &Length, " %d",
+                  inputs[k * lanes + lane]);
+  }
+  if (!Fits || !Append(Command, sizeof(Command), &Length, " | %s", program)) {
+    fprintf(stderr, "Command line for %s is too long\n", program);
+    return -1;
+  }
+
+  FILE *Output = popen(Command, "r");
+  if (Output == NULL) {
+    perror("popen");
+    return -1;
+  }
+
+  int Mismatch = 0;
+  int32_t Value;
+  int32_t Count = 0;
+  while (fscanf(Output, "%d", &Value) == 1) {
+    if (Count >= counts[lane] || Value != outputs[Count * lanes + lane]) {
+      Mismatch = 1;
+    }
+    ++Count;
+  }
+
+  return pclose(Output) != 0 || Mismatch || Count != counts[lane];
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <scalar executable> [lanes] [processes]\n",
+            argv[0]);
+    return 1;
+  }
+
+  int64_t Lanes = argc > 2 ? atol(argv[2]) : 10000000;
+  int64_t Processes = argc > 3 ? atol(argv[3]) : 200;
+  if (Processes > Lanes) {
+    Processes = Lanes;
+  }
+
+  int32_t NumInputs = toy_batch_inputs();
+  int32_t NumOutputs = toy_batch_outputs();
+  int32_t *Inputs = malloc(sizeof(int32_t) * NumInputs * Lanes);
+  int32_t *Outputs = malloc(sizeof(int32_t) * NumOutputs * Lanes);
+  int32_t *Counts = malloc(sizeof(int32_t) * Lanes);
+  if (Inputs == NULL || Outputs == NULL || Counts == NULL) {
+    fprintf(stderr, "Out of memory\n");
+    return 1;
+  }
+
+  uint32_t Seed = 1;
+  for (int64_t i = 0; i < NumInputs * Lanes; ++i) {
+    Seed = Seed * 1103515245u + 12345u;
+    Inputs[i] = (int32_t)(Seed >> 16) % 512 - 256;
+  }
+
+  double Start = Now();
+  toy_batch(Inputs, Outputs, Counts, Lanes);
+  double Batch = Now() - Start;
+
+  int Failed = 0;
+  Start = Now();
+  for (int64_t lane = 0; lane < Processes; ++lane) {
+    Failed += RunScalar(argv[1], Inputs, Outputs, Counts, Lanes, lane) != 0;
+  }
+  double Scalar = Now() - Start;
+
+  fprintf(stderr, "batch   %10.0f input sets/s (%lld sets, %.3f s)\n",
+          Lanes / Batch, (long long)Lanes, Batch);
+  fprintf(stderr, "scalar  %10.0f input sets/s (%lld processes, %.3f s)\n",
+          Processes / Scalar, (long long)Processes, Scalar);
+  if (Failed != 0) {
+    fprintf(stderr, "%d of %lld scalar runs disagree with toy_batch\n",
+            Failed, (long long)Processes);
+    return 1;
+  }
+
+  free(Inputs);
+  free(Outputs);
+  free(Counts);
+  return 0;
+}
@@ -0,0 +1,99 @@
+#!/bin/bash
+
+# Интерпретатор байт-кода (toycompiler --run) против компиляции
+# в машинный код (./compile) с последующим запуском программы.
+#
+# Для каждого размера программы (числа операторов) gentoy создает
+# программу вида kind, и она исполняется обоими способами на одних
+# и тех же входных данных. Время - минимум по нескольким повторам,
+# для компиляции в него входит и запуск программы. Последняя строка -
+# наименьший размер, с которого компиляция выгоднее, или "none".
+#
+# Запуск из каталога компилятора:
+#   bench/crossover.sh [-r repeats] [-k kind] [size...]
+
+REPEATS=3
+KIND=mixed
+GENTOY=bench/gentoy
+COMPILER=./toycompiler
+WORK=`mktemp -d /tmp/crossover.XXXXXXXXXX`
+
+trap 'rm -rf $WORK' EXIT
+
+while [ $# -gt 0 ]; do
+    case $1 in
+        -r) REPEATS=$2; shift 2 ;;
+        -k) KIND=$2; shift 2 ;;
+        *) break ;;
+    esac
+done
+
+SIZES="$@"
+if [ "x$SIZES" = "x" ]; then
+    SIZES="10 100 1000 10000 100000 300000"
+fi
+
+if [ ! -x $GENTOY -o ! -x $COMPILER ]; then
+    echo "Build $GENTOY and $COMPILER first (make bench-crossover)"
+    exit 1
+fi
+
+now_ms() {
+    echo $((`date +%s%N` / 1000000))
+}
+
+# Наименьшее время выполнения команды в миллисекундах; stdin команды -
+# файл входных данных, stdout отбрасывается.
+best_ms() {
+    local input=$1
+    shift
+    local best=""
+    for i in `seq $REPEATS`; do
+        local start=`now_ms`
+        "$@" < $input > /dev/null || return 1
+        local elapsed=$((`now_ms` - start))
+        if [ "x$best" = "x" ] || [ $elapsed -lt $best ]; then
+            best=$elapsed
+        fi
+    done
+    echo $best
+}
+
+# main программы возвращает void, поэтому код завершения скомпилированной
+# программы не определен и не проверяется.
+run_native() {
+    $WORK/prog
+    return 0
+}
+
+compile_and_run() {
+    rm -f $WORK/prog
+    ./compile $WORK/prog.toy $WORK/prog > /dev/null && run_native
+}
+
+echo "# toycompiler crossover v1 kind=$KIND repeats=$REPEATS"
+printf "%-12s %10s %12s %12s %12s\n" "# statements" "inputs" "run ms" \
+       "compile ms" "native ms"
+
+CROSSOVER=none
+for SIZE in $SIZES; do
+    $GENTOY -k $KIND -n $SIZE > $WORK/prog.toy || exit 1
+
+    # По одному числу на каждый оператор input в тексте: в программах
+    # вида mixed часть из них стоит в ветвях и не исполняется.
+    INPUTS=`grep -c '^[[:space:]]*input[[:space:]]' $WORK/prog.toy`
+    awk -v n=$INPUTS 'BEGIN { s = 1; for (i = 0; i < n; ++i) {
+        s = (s * 69069 + 1) % 4294967296; print s % 2001 - 1000 } }' \
+        > $WORK/prog.in
+
+    RUN=`best_ms $WORK/prog.in $COMPILER --run $WORK/prog.toy` || exit 1
+    TOTAL=`best_ms $WORK/prog.in compile_and_run` || exit 1
+    NATIVE=`best_ms $WORK/prog.in run_native` || exit 1
+
+    printf "%-12s %10s %12s %12s %12s\n" $SIZE $INPUTS $RUN $TOTAL $NATIVE
+    if [ $CROSSOVER = none ] && [ $TOTAL -lt $RUN ]; then
+        CROSSOVER=$SIZE
+    fi
+done
+
+echo "# crossover $CROSSOVER"
@@ -0,0 +1,251 @@
+// Бенчмарк фаз компилятора на синтетических программах (см. toygen.h).
+//
+// Каждая фаза замеряется отдельно: лексический анализ (Lexer::GetToken),
+// разбор (Parser::Parse вместе с лексером, как в драйвере), создание
+// переменных (GeneratorState::AddVariables), генерация IR и оптимизация
+// (GeneratorState::Optimize). Генерация и оптимизация замеряются
+// дважды: с ячейками для переменных и с прямым построением SSA
+// (строки *-ssa). Параметры программы меняются по одному относительно
+// базовой конфигурации.
+//
+// Вывод - таблица с фиксированным порядком строк и столбцов, которую
+// можно сравнивать между ревизиями через diff. Время - минимум по
+// нескольким повторам; ir - число инструкций IR после фазы.
+//
+// Запуск: ./frontbench [-r repeats] [-O level] [-q] [-f] [-n]
+//   -O - уровень оптимизации; -O 1 - прежний фиксированный конвейер,
+//        с которым сравнивается конвейер -O 3 (make bench-pipeline);
+//   -q - без самых больших программ;
+//   -f - только лексический анализ и разбор;
+//   -n - узлы дерева выделяются по одному через new, а не в арене.
+// Последняя строка - пиковый RSS процесса. Сравнение арены с new:
+// ./frontbench -f и ./frontbench -f -n (make bench-arena).
+
+#include "../arena.h"
+#include "../ast.h"
+#include "../generator.h"
+#include "../parser.h"
+#include "../symbols.h"
+#include "toygen.h"
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double ElapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+enum Phase {
+  PHASE_LEX,
+  PHASE_PARSE,
+  PHASE_VARIABLES,
+  PHASE_CODEGEN,
+  PHASE_OPTIMIZE,
+  PHASE_CODEGEN_SSA,
+  PHASE_OPTIMIZE_SSA,
+  NUM_PHASES
+};
+
+const char *const PhaseNames[NUM_PHASES] = {
+    "lex",      "parse",       "variables",   "codegen",
+    "optimize", "codegen-ssa", "optimize-ssa"};
+
+struct PhaseTimes {
+  double Ms[NUM_PHASES];
+  size_t Instructions[NUM_PHASES];
+
+  PhaseTimes() {
+    for (unsigned p = 0; p < NUM_PHASES; ++p) {
+      Ms[p] = 1e100;
+      Instructions[p] = 0;
+    }
+  }
+
+  void Keep(Phase phase, Clock::time_point start) {
+    double Elapsed = ElapsedMs(start);
+    if (Elapsed < Ms[phase]) {
+      Ms[phase] = Elapsed;
+    }
+  }
+};
+
+// Генерация и оптимизация в одном из режимов.
+void RunBackend(StmtNode *prog, const VariableTable &symbols,
+                unsigned optLevel, bool directSSA, PhaseTimes &times) {
+  LLVMContext Context;
+  GeneratorState Gen(Context);
+  Gen.DirectSSA = directSSA;
+
+  Clock::time_point Start = Clock::now();
+  Gen.AddVariables(symbols);
+  if (!directSSA) {
+    times.Keep(PHASE_VARIABLES, Start);
+  }
+
+  Phase Codegen = directSSA ? PHASE_CODEGEN_SSA : PHASE_CODEGEN;
+  Start = Clock::now();
+  prog->Generate(&Gen);
+  Gen.Builder->CreateRetVoid();
+  times.Keep(Codegen, Start);
+  times.Instructions[Codegen] = Gen.CountInstructions();
+
+  Phase Optimize = directSSA ? PHASE_OPTIMIZE_SSA : PHASE_OPTIMIZE;
+  Start = Clock::now();
+  Gen.Optimize(optLevel);
+  times.Keep(Optimize, Start);
+  times.Instructions[Optimize] = Gen.CountInstructions();
+
+  delete Gen.GetMainModule();
+}
+
+// Один прогон всех фаз над текстом программы.
+bool RunOnce(const std::string &text, unsigned optLevel, bool frontOnly,
+             bool perNodeNew, PhaseTimes &times) {
+  {
+    std::istringstream Input(text);
+    VariableTable Symbols;
+    Lexer Lex(Input, Symbols);
+    Clock::time_point Start = Clock::now();
+    while (Lex.GetToken() != tok_eof) {
+    }
+    times.Keep(PHASE_LEX, Start);
+  }
+
+  std::istringstream Input(text);
+  VariableTable Symbols;
+  Lexer Lex(Input, Symbols);
+  Arena Nodes(perNodeNew);
+
+  Clock::time_point Start = Clock::now();
+  Parser P(Lex, Nodes, Symbols);
+  StmtNode *Prog = P.Parse();
+  times.Keep(PHASE_PARSE, Start);
+
+  if (!P.ParserSuccess()) {
+    return false;
+  }
+
+  if (frontOnly) {
+    return true;
+  }
+
+  RunBackend(Prog, Symbols, optLevel, false, times);
+  RunBackend(Prog, Symbols, optLevel, true, times);
+  return true;
+}
+
+void PrintRow(Phase phase, const ToyGenOptions &options, size_t bytes,
+              const PhaseTimes &times) {
+  double Ms = times.Ms[phase];
+  printf("%-12s %10zu %6u %5u %5u %10zu %10.3f %10.2f %9.1f ",
+         PhaseNames[phase], options.Statements, options.Variables,
+         options.ExprLength, options.Depth, bytes, Ms,
+         bytes / 1048576.0 / (Ms / 1000.0), Ms * 1e6 / options.Statements);
+  if (times.Instructions[phase] > 0) {
+    printf("%9zu\n", times.Instructions[phase]);
+  } else {
+    printf("%9s\n", "-");
+  }
+}
+
+ToyGenOptions Config(size_t statements, unsigned variables, unsigned expr,
+                     unsigned depth) {
+  ToyGenOptions Options;
+  Options.Statements = statements;
+  Options.Variables = variables;
+  Options.ExprLength = expr;
+  Options.Depth = depth;
+  return Options;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  unsigned Repeats = 3;
+  unsigned OptLevel = 3;
+  bool Quick = false;
+  bool FrontOnly = false;
+  bool PerNodeNew = false;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      Repeats = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "-O") == 0 && i + 1 < argc) {
+      OptLevel = strtoul(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "-q") == 0) {
+      Quick = true;
+    } else if (strcmp(argv[i], "-f") == 0) {
+      FrontOnly = true;
+    } else if (strcmp(argv[i], "-n") == 0) {
+      PerNodeNew = true;
+    } else {
+      fprintf(stderr,
+              "Usage: frontbench [-r repeats] [-O level] [-q] [-f] [-n]\n");
+      return 1;
+    }
+  }
+
+  if (Repeats == 0 || OptLevel > 3) {
+    fprintf(stderr, "Invalid repeats or optimization level\n");
+    return 1;
+  }
+
+  // Базовая конфигурация: 10000 операторов, 64 переменные, выражения
+  // из 4 слагаемых, вложенность if до 2. Каждая следующая группа
+  // меняет один параметр.
+  std::vector<ToyGenOptions> Configs;
+  Configs.push_back(Config(1000, 64, 4, 2));
+  Configs.push_back(Config(10000, 64, 4, 2));
+  if (!Quick) {
+    Configs.push_back(Config(100000, 64, 4, 2));
+  }
+  Configs.push_back(Config(10000, 8, 4, 2));
+  Configs.push_back(Config(10000, 512, 4, 2));
+  Configs.push_back(Config(10000, 4096, 4, 2));
+  Configs.push_back(Config(10000, 64, 1, 2));
+  Configs.push_back(Config(10000, 64, 16, 2));
+  Configs.push_back(Config(10000, 64, 64, 2));
+  Configs.push_back(Config(10000, 64, 4, 0));
+  Configs.push_back(Config(10000, 64, 4, 4));
+  Configs.push_back(Config(10000, 64, 4, 8));
+
+  printf("# toycompiler frontbench v3 -O%u repeats=%u nodes=%s\n", OptLevel,
+         Repeats, PerNodeNew ? "new" : "arena");
+  printf("%-12s %10s %6s %5s %5s %10s %10s %10s %9s %9s\n", "# phase",
+         "statements", "vars", "expr", "depth", "bytes", "ms", "MB/s",
+         "ns/stmt", "ir");
+
+  for (const ToyGenOptions &Options : Configs) {
+    std::string Text = GenerateToyProgram(Options);
+
+    PhaseTimes Times;
+    for (unsigned r = 0; r < Repeats; ++r) {
+      if (!RunOnce(Text, OptLevel, FrontOnly, PerNodeNew, Times)) {
+        fprintf(stderr, "Generated program failed to parse\n");
+        return 1;
+      }
+    }
+
+    unsigned Phases = FrontOnly ? PHASE_VARIABLES : NUM_PHASES;
+    for (unsigned p = 0; p < Phases; ++p) {
+      PrintRow(static_cast<Phase>(p), Options, Text.size(), Times);
+    }
+  }
+
+  struct rusage Usage;
+  getrusage(RUSAGE_SELF, &Usage);
+  printf("# peak_rss_kb %ld\n", Usage.ru_maxrss);
+  return 0;
+}
@@ -0,0 +1,45 @@
+// Генерация синтетической программы в stdout.
+//
+// Запуск: ./gentoy [-n statements] [-v variables] [-e terms] [-d depth]
+//                  [-k mixed|io|arith|branch] [-s seed]
+
+#include "toygen.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  ToyGenOptions Options;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    unsigned long Value = strtoul(argv[i + 1], nullptr, 10);
+    if (strcmp(argv[i], "-n") == 0) {
+      Options.Statements = Value;
+    } else if (strcmp(argv[i], "-v") == 0 && Value > 0) {
+      Options.Variables = Value;
+    } else if (strcmp(argv[i], "-e") == 0 && Value > 0) {
+      Options.ExprLength = Value;
+    } else if (strcmp(argv[i], "-d") == 0) {
+      Options.Depth = Value;
+    } else if (strcmp(argv[i], "-k") == 0) {
+      if (!ParseToyShape(argv[i + 1], Options.Shape)) {
+        std::cerr << "Unknown shape " << argv[i + 1] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-s") == 0) {
+      Options.Seed = Value;
+    } else {
+      std::cerr << "Usage: gentoy [-n statements] [-v variables] "
+                   "[-e terms] [-d depth] [-k shape] [-s seed]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (argc % 2 == 0) {
+    std::cerr << "Missing value for " << argv[argc - 1] << std::endl;
+    return 1;
+  }
+
+  std::cout << GenerateToyProgram(Options);
+  return 0;
+}
@@ -0,0 +1,98 @@
+// Сравнение пропускной способности ввода-вывода toystd.c
+// с прежней реализацией на scanf/printf.
+//
+// Запуск: ./iobench [count] > /dev/null
+// Результаты печатаются в stderr.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../toystd.h"
+
+static int32_t StdioInput() {
+  int32_t Value = 0;
+  if (scanf("%d", &Value) != 1) {
+    return 0;
+  }
+  return Value;
+}
+
+static void StdioPrint(int32_t value) { printf("%d\n", value); }
+
+static double Now(void) {
+  struct timespec Time;
+  clock_gettime(CLOCK_MONOTONIC, &Time);
+  return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void Report(const char *name, long count, double seconds) {
+  fprintf(stderr, "%-14s %8.3f s  %8.1f M ints/s\n", name, seconds,
+          count / seconds * 1e-6);
+}
+
+int main(int argc, char **argv) {
+  long Count = argc > 1 ? atol(argv[1]) : 10000000;
+
+  // Входные данные: числа разных знаков и длины.
+  char Path[] = "/tmp/iobenchXXXXXX";
+  int Fd = mkstemp(Path);
+  if (Fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  unlink(Path);
+
+  FILE *Data = fdopen(dup(Fd), "w");
+  uint32_t Seed = 1;
+  for (long i = 0; i < Count; ++i) {
+    Seed = Seed * 1103515245u + 12345u;
+    fprintf(Data, "%d\n", (int32_t)Seed >> (Seed % 24));
+  }
+  fclose(Data);
+
+  // Старая реализация читает через stdin, новая - прямо из дескриптора 0,
+  // поэтому между замерами достаточно перемотать файл.
+  dup2(Fd, 0);
+  int64_t Sum = 0;
+
+  lseek(0, 0, SEEK_SET);
+  double Start = Now();
+  for (long i = 0; i < Count; ++i) {
+    Sum += StdioInput();
+  }
+  Report("input/stdio", Count, Now() - Start);
+
+  lseek(0, 0, SEEK_SET);
+  Start = Now();
+  for (long i = 0; i < Count; ++i) {
+    Sum -= builtin_input();
+  }
+  Report("input/toystd", Count, Now() - Start);
+
+  if (Sum != 0) {
+    fprintf(stderr, "input mismatch: %lld\n", (long long)Sum);
+    return 1;
+  }
+
+  Start = Now();
+  for (long i = 0; i < Count; ++i) {
+    StdioPrint((int32_t)(i * 2654435761u));
+  }
+  fflush(stdout);
+  Report("output/stdio", Count, Now() - Start);
+
+  Start = Now();
+  for (long i = 0; i < Count; ++i) {
+    builtin_print((int32_t)(i * 2654435761u));
+  }
+  builtin_flush();
+  Report("output/toystd", Count, Now() - Start);
+
+  close(Fd);
+  return 0;
+}
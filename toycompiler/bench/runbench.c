@@ -0,0 +1,262 @@
+// Бенчмарк скомпилированных программ: пропускная способность
+// и число инструкций на одно входное значение.
+//
+// Для каждой программы prog рядом лежит ее исходный текст prog.toy.
+// Программы корпуса (см. toygen.h) читают ввод только на верхнем
+// уровне, поэтому число прочитанных значений равно числу операторов
+// input в тексте. Входной поток такой длины записывается в prog.in
+// при первом запуске и дальше используется повторно.
+//
+// Время и инструкции - минимум по нескольким запускам. Из них
+// вычитаются затраты базовой программы (-b, обычно пустой), то есть
+// запуск процесса и инициализация стандартной библиотеки. Инструкции
+// считаются через perf_event_open; если счетчики недоступны,
+// печатается "-".
+//
+// Запуск: ./runbench [-r repeats] [-b baseline] prog...
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  double Ms;
+  int64_t Instructions; // -1, если счетчик недоступен.
+} RunResult;
+
+static double Now(void) {
+  struct timespec Time;
+  clock_gettime(CLOCK_MONOTONIC, &Time);
+  return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+// Число операторов input в исходном тексте.
+static long CountInputs(const char *source) {
+  FILE *File = fopen(source, "r");
+  if (File == NULL) {
+    return -1;
+  }
+
+  long Count = 0;
+  char Line[4096];
+  while (fgets(Line, sizeof(Line), File) != NULL) {
+    const char *P = Line;
+    while (*P == ' ' || *P == '\t') {
+      ++P;
+    }
+    if (strncmp(P, "input", 5) == 0 && (P[5] == ' ' || P[5] == '\t')) {
+      ++Count;
+    }
+  }
+
+  fclose(File);
+  return Count;
+}
+
+// Запись входного потока: числа разных знаков и длины.
+static int WriteInput(const char *path, long count) {
+  struct stat Info;
+  if (stat(path, &Info) == 0) {
+    return 0;
+  }
+
+  FILE *Data = fopen(path, "w");
+  if (Data == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  uint32_t Seed = 1;
+  for (long i = 0; i < count; ++i) {
+    Seed = Seed * 1103515245u + 12345u;
+    fprintf(Data, "%d\n", (int32_t)Seed >> (8 + Seed % 20));
+  }
+
+  return fclose(Data);
+}
+
+static int OpenCounter(pid_t pid) {
+  struct perf_event_attr Attr;
+  memset(&Attr, 0, sizeof(Attr));
+  Attr.type = PERF_TYPE_HARDWARE;
+  Attr.size = sizeof(Attr);
+  Attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  Attr.disabled = 1;
+  Attr.enable_on_exec = 1;
+  Attr.inherit = 1;
+  Attr.exclude_kernel = 1;
+  Attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &Attr, pid, -1, -1, 0);
+}
+
+// Один запуск программы с stdin из файла и stdout в /dev/null.
+static int Run(const char *program, const char *input, RunResult *result) {
+  int Sync[2];
+  if (pipe(Sync) != 0) {
+    perror("pipe");
+    return -1;
+  }
+
+  double Start = Now();
+  pid_t Child = fork();
+  if (Child < 0) {
+    perror("fork");
+    return -1;
+  }
+
+  if (Child == 0) {
+    // Ребенок ждет, пока родитель подключит счетчик.
+    char Byte;
+    close(Sync[1]);
+    if (read(Sync[0], &Byte, 1) != 1) {
+      _exit(127);
+    }
+
+    int In = open(input != NULL ? input : "/dev/null", O_RDONLY);
+    int Out = open("/dev/null", O_WRONLY);
+    if (In < 0 || Out < 0) {
+      _exit(127);
+    }
+    dup2(In, 0);
+    dup2(Out, 1);
+    execl(program, program, (char *)NULL);
+    _exit(127);
+  }
+
+  close(Sync[0]);
+  int Counter = OpenCounter(Child);
+  if (write(Sync[1], "", 1) != 1) {
+    perror("write");
+  }
+  close(Sync[1]);
+
+  int Status;
+  waitpid(Child, &Status, 0);
+  result->Ms = (Now() - Start) * 1000.0;
+
+  result->Instructions = -1;
+  if (Counter >= 0) {
+    int64_t Value;
+    if (read(Counter, &Value, sizeof(Value)) == sizeof(Value)) {
+      result->Instructions = Value;
+    }
+    close(Counter);
+  }
+
+  if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0) {
+    fprintf(stderr, "%s failed\n", program);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int Measure(const char *program, const char *input, unsigned repeats,
+                   RunResult *best) {
+  best->Ms = 1e100;
+  best->Instructions = -1;
+
+  for (unsigned r = 0; r < repeats; ++r) {
+    RunResult Result;
+    if (Run(program, input, &Result) != 0) {
+      return -1;
+    }
+
+    if (Result.Ms < best->Ms) {
+      best->Ms = Result.Ms;
+    }
+    if (Result.Instructions >= 0 &&
+        (best->Instructions < 0 || Result.Instructions < best->Instructions)) {
+      best->Instructions = Result.Instructions;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  unsigned Repeats = 5;
+  const char *Baseline = NULL;
+  int First = 1;
+
+  while (First < argc && argv[First][0] == '-') {
+    if (strcmp(argv[First], "-r") == 0 && First + 1 < argc) {
+      Repeats = strtoul(argv[First + 1], NULL, 10);
+    } else if (strcmp(argv[First], "-b") == 0 && First + 1 < argc) {
+      Baseline = argv[First + 1];
+    } else {
+      break;
+    }
+    First += 2;
+  }
+
+  if (First >= argc || argv[First][0] == '-' || Repeats == 0) {
+    fprintf(stderr, "Usage: runbench [-r repeats] [-b baseline] prog...\n");
+    return 1;
+  }
+
+  RunResult Base = {0.0, 0};
+  if (Baseline != NULL && Measure(Baseline, NULL, Repeats, &Base) != 0) {
+    return 1;
+  }
+
+  printf("# toycompiler runbench v1 repeats=%u\n", Repeats);
+  printf("%-20s %10s %10s %10s %10s %12s\n", "# program", "inputs", "bytes",
+         "ms", "M inputs/s", "instr/input");
+
+  for (int i = First; i < argc; ++i) {
+    const char *Program = argv[i];
+    size_t Length = strlen(Program);
+    char *Source = malloc(Length + 5);
+    char *Input = malloc(Length + 4);
+    sprintf(Source, "%s.toy", Program);
+    sprintf(Input, "%s.in", Program);
+
+    long Inputs = CountInputs(Source);
+    if (Inputs < 0) {
+      perror(Source);
+      return 1;
+    }
+    if (WriteInput(Input, Inputs) != 0) {
+      return 1;
+    }
+
+    struct stat Info;
+    long Bytes = stat(Input, &Info) == 0 ? (long)Info.st_size : 0;
+
+    RunResult Result;
+    if (Measure(Program, Input, Repeats, &Result) != 0) {
+      return 1;
+    }
+
+    double Ms = Result.Ms - Base.Ms;
+    printf("%-20s %10ld %10ld %10.3f ", Program, Inputs, Bytes, Ms);
+    if (Inputs > 0 && Ms > 0) {
+      printf("%10.2f ", Inputs / Ms * 1e-3);
+    } else {
+      printf("%10s ", "-");
+    }
+    if (Inputs > 0 && Result.Instructions >= 0 && Base.Instructions >= 0) {
+      printf("%12.1f\n",
+             (double)(Result.Instructions - Base.Instructions) / Inputs);
+    } else {
+      printf("%12s\n", "-");
+    }
+
+    free(Source);
+    free(Input);
+  }
+
+  return 0;
+}
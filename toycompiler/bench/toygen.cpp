@@ -0,0 +1,139 @@
+#include "toygen.h"
+
+namespace {
+
+// Доли присваиваний, печати и ввода из 20; остальное - условные
+// операторы.
+struct ShapeWeights {
+  unsigned Assign, Print, Input;
+};
+
+const ShapeWeights Weights[] = {
+    {12, 2, 1}, // SHAPE_MIXED
+    {2, 9, 9},  // SHAPE_IO
+    {17, 2, 1}, // SHAPE_ARITH
+    {5, 1, 4},  // SHAPE_BRANCH
+};
+
+class ToyGenerator {
+  const ToyGenOptions &Options;
+  std::string Text;
+  uint64_t State;
+  size_t Emitted;
+
+  // Линейный конгруэнтный генератор (константы Кнута, MMIX).
+  unsigned Random(unsigned bound) {
+    State = State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned)((State >> 33) % bound);
+  }
+
+  void Indent(unsigned depth) { Text.append(2 * depth, ' '); }
+
+  void Variable() {
+    Text += 'v';
+    Text += std::to_string(Random(Options.Variables));
+  }
+
+  void Expr() {
+    for (unsigned i = 0; i < Options.ExprLength; ++i) {
+      if (i > 0) {
+        Text += Random(2) ? " + " : " - ";
+      }
+
+      if (Random(4) == 0) {
+        Text += std::to_string(Random(1000));
+      } else {
+        Variable();
+      }
+    }
+  }
+
+  void Stmt(unsigned depth) {
+    ++Emitted;
+    const ShapeWeights &W = Weights[Options.Shape];
+    unsigned Kind = Random(20);
+    unsigned PrintEnd = W.Assign + W.Print;
+    unsigned InputEnd = PrintEnd + W.Input;
+    bool NestedInput = Kind >= PrintEnd && Kind < InputEnd && depth > 0 &&
+                       Options.Shape != SHAPE_MIXED;
+    Indent(depth);
+
+    if (Kind < W.Assign || NestedInput ||
+        (Kind >= InputEnd && depth >= Options.Depth)) {
+      Variable();
+      Text += " = ";
+      Expr();
+      Text += '\n';
+    } else if (Kind < PrintEnd) {
+      Text += "print ";
+      Expr();
+      Text += '\n';
+    } else if (Kind < InputEnd) {
+      Text += "input ";
+      Variable();
+      Text += '\n';
+    } else {
+      static const char *const Ops[] = {"negative", "zero", "positive"};
+      Text += "if ";
+      Expr();
+      Text += " is ";
+      Text += Ops[Random(3)];
+      Text += '\n';
+      Block(depth + 1);
+      if (Random(2)) {
+        Indent(depth);
+        Text += "else\n";
+        Block(depth + 1);
+      }
+      Indent(depth);
+      Text += "end\n";
+    }
+  }
+
+  void Block(unsigned depth) {
+    unsigned Count = 1 + Random(3);
+    for (unsigned i = 0; i < Count && Emitted < Options.Statements; ++i) {
+      Stmt(depth);
+    }
+  }
+
+public:
+  ToyGenerator(const ToyGenOptions &options)
+      : Options(options), State(options.Seed), Emitted(0) {}
+
+  std::string Run() {
+    // Начальные значения вводятся, а не присваиваются константами:
+    // иначе свертка констант и анализ диапазонов вычислили бы большую
+    // часть программы при компиляции.
+    for (unsigned i = 0; i < Options.Variables && Emitted < Options.Statements;
+         ++i) {
+      ++Emitted;
+      Text += "input v" + std::to_string(i) + '\n';
+    }
+
+    while (Emitted < Options.Statements) {
+      Stmt(0);
+    }
+
+    return Text;
+  }
+};
+
+} // namespace
+
+std::string GenerateToyProgram(const ToyGenOptions &options) {
+  ToyGenerator Generator(options);
+  return Generator.Run();
+}
+
+bool ParseToyShape(const std::string &name, ToyShape &shape) {
+  static const char *const Names[] = {"mixed", "io", "arith", "branch"};
+  for (unsigned i = 0; i < sizeof(Names) / sizeof(Names[0]); ++i) {
+    if (name == Names[i]) {
+      shape = static_cast<ToyShape>(i);
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Вид программы: доли операторов разных типов.
+enum ToyShape {
+  SHAPE_MIXED,  // Смесь всех операторов (для бенчмарка компилятора).
+  SHAPE_IO,     // В основном ввод и печать.
+  SHAPE_ARITH,  // В основном присваивания длинных выражений.
+  SHAPE_BRANCH  // В основном условные операторы.
+};
+
+// Генератор синтетических программ на игрушечном языке для бенчмарков.
+//
+// Программа начинается с ввода всех переменных, затем идут случайные
+// присваивания, печать, ввод и условные операторы. Случайные числа
+// берутся из собственного генератора, поэтому при одном и том же
+// зерне текст программы одинаков на любой платформе.
+//
+// Во всех видах, кроме SHAPE_MIXED, ввод встречается только на верхнем
+// уровне, так что число прочитанных значений не зависит от входных
+// данных и равно числу операторов input в тексте.
+struct ToyGenOptions {
+  size_t Statements;  // Общее число операторов, включая вложенные.
+  unsigned Variables; // Число различных переменных.
+  unsigned ExprLength; // Число слагаемых в выражении.
+  unsigned Depth;      // Наибольшая вложенность if.
+  ToyShape Shape;
+  uint64_t Seed;
+
+  ToyGenOptions()
+      : Statements(10000), Variables(64), ExprLength(4), Depth(2),
+        Shape(SHAPE_MIXED), Seed(1) {}
+};
+
+std::string GenerateToyProgram(const ToyGenOptions &options);
+
+// Вид программы по имени (mixed, io, arith, branch).
+bool ParseToyShape(const std::string &name, ToyShape &shape);
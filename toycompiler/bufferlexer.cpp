@@ -0,0 +1,168 @@
+#include "bufferlexer.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Классы символов
+// =====================================================================
+
+static inline bool IsBlank(char c) { return c == ' ' || c == '\t'; }
+
+static inline bool IsNewline(char c) { return c == '\n' || c == '\r'; }
+
+static inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+static inline bool IsAlpha(char c) {
+  char Lower = c | 0x20;
+  return Lower >= 'a' && Lower <= 'z';
+}
+
+static inline bool IsAlnum(char c) { return IsAlpha(c) || IsDigit(c); }
+
+#ifdef __SSE2__
+// Маски символов из диапазона [lo, hi] для 16 байт сразу.
+// Байты >= 0x80 при знаковом сравнении отрицательны и в диапазон
+// не попадают, как и у скалярных функций выше.
+static inline __m128i InRange(__m128i chunk, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(chunk, _mm_set1_epi8(hi + 1)));
+}
+
+static inline __m128i BlankMask(__m128i chunk) {
+  return _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                      _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')));
+}
+
+static inline __m128i DigitMask(__m128i chunk) {
+  return InRange(chunk, '0', '9');
+}
+
+static inline __m128i AlnumMask(__m128i chunk) {
+  __m128i Lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+  return _mm_or_si128(InRange(Lower, 'a', 'z'), DigitMask(chunk));
+}
+#endif
+
+// Пропуск серии символов одного класса: возвращает указатель
+// на первый символ, не входящий в класс.
+#ifdef __SSE2__
+#define SKIP_RUN(p, end, Scalar, Vector)                                       \
+  do {                                                                         \
+    while ((end) - (p) >= 16) {                                                \
+      __m128i Chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));   \
+      unsigned Mask = ~_mm_movemask_epi8(Vector(Chunk)) & 0xFFFF;              \
+      if (Mask != 0) {                                                         \
+        (p) += __builtin_ctz(Mask);                                            \
+        break;                                                                 \
+      }                                                                        \
+      (p) += 16;                                                               \
+    }                                                                          \
+    while ((p) < (end) && Scalar(*(p)))                                        \
+      ++(p);                                                                   \
+  } while (0)
+#else
+#define SKIP_RUN(p, end, Scalar, Vector)                                       \
+  do {                                                                         \
+    while ((p) < (end) && Scalar(*(p)))                                        \
+      ++(p);                                                                   \
+  } while (0)
+#endif
+
+static inline const char *SkipBlanks(const char *p, const char *end) {
+  SKIP_RUN(p, end, IsBlank, BlankMask);
+  return p;
+}
+
+static inline const char *SkipDigits(const char *p, const char *end) {
+  SKIP_RUN(p, end, IsDigit, DigitMask);
+  return p;
+}
+
+static inline const char *SkipAlnum(const char *p, const char *end) {
+  SKIP_RUN(p, end, IsAlnum, AlnumMask);
+  return p;
+}
+
+// Лексический анализатор
+// =====================================================================
+
+void BufferLexer::Tokenize() {
+  Tokenized = true;
+  Tokens.clear();
+  // Массив растет по мере разбора: число лексем по размеру текста
+  // не угадать (от трех байт на лексему в плотном коде до десятков
+  // при длинных именах и отступах), а заранее отведенный под худший
+  // случай массив в пять раз больше самого текста.
+
+  const char *p = Begin;
+  while (true) {
+    // Большинство серий пробелов короткие, поэтому сначала
+    // проверяем один символ, а векторный поиск запускаем только
+    // для длинных отступов.
+    if (p < End && IsBlank(*p)) {
+      p = SkipBlanks(p + 1, End);
+    }
+
+    if (p == End) {
+      Emit(tok_eof, p, p, 0);
+      break;
+    }
+
+    const char *Start = p;
+    char c = *p;
+
+    if (IsAlpha(c)) {
+      // Идентификатор или ключевое слово.
+      p = SkipAlnum(p + 1, End);
+      int Kind = KeywordToken(Start, p - Start);
+      int Value = 0;
+      if (Kind == tok_identifier) {
+        Scratch.assign(Start, p - Start);
+        Value = Symbols.Intern(Scratch);
+      }
+
+      Emit(Kind, Start, p, Value);
+    } else if (IsDigit(c)) {
+      // Константа. Переполнение, как и раньше, не проверяется.
+      p = SkipDigits(p + 1, End);
+      unsigned Value = 0;
+      for (const char *d = Start; d != p; ++d) {
+        Value = Value * 10 + (*d - '0');
+      }
+
+      Emit(tok_const, Start, p, (int)Value);
+    } else if (IsNewline(c)) {
+      // Несколько символов перевода строки считаем одним.
+      while (p < End && IsNewline(*p)) {
+        ++p;
+      }
+
+      Emit(tok_newline, Start, p, 0);
+    } else {
+      // Любой другой символ возвращается сам по себе.
+      ++p;
+      Emit((unsigned char)c, Start, p, 0);
+    }
+  }
+}
+
+int BufferLexer::GetToken() {
+  if (!Tokenized) {
+    Tokenize();
+  }
+
+  const TokenInfo &Token = Tokens[Position];
+  // Последняя лексема - всегда tok_eof, дальше не двигаемся.
+  if (Position + 1 < Tokens.size()) {
+    ++Position;
+  }
+
+  if (Token.Kind == tok_identifier) {
+    IdentifierId = Token.Value;
+  } else if (Token.Kind == tok_const) {
+    ConstValue = Token.Value;
+  }
+
+  return Token.Kind;
+}
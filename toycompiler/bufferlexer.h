@@ -0,0 +1,61 @@
+#pragma once
+
+#include "parser.h"
+#include "symbols.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Лексический анализатор над исходным текстом, целиком лежащим в памяти
+// (см. SourceBuffer).
+//
+// Текст разбирается за один проход в компактный массив лексем; классы
+// символов (пробелы, цифры, буквы) определяются векторными сравнениями
+// по 16 байт. Лексемы не копируют текст, а ссылаются на него смещением
+// и длиной, поэтому буфер должен жить дольше анализатора.
+class BufferLexer : public TokenSource {
+public:
+  // Лексема в массиве: вид, положение в тексте и значение
+  // (константа или номер переменной).
+  struct TokenInfo {
+    int32_t Kind;
+    uint32_t Offset;
+    uint32_t Length;
+    int32_t Value;
+  };
+
+  BufferLexer(const char *begin, const char *end, VariableTable &symbols)
+      : Begin(begin), End(end), Symbols(symbols), Position(0),
+        Tokenized(false) {}
+
+  // Разбор всего текста в массив лексем. Вызывается автоматически
+  // при первом обращении к GetToken.
+  void Tokenize();
+
+  // Очередная лексема из массива.
+  virtual int GetToken();
+
+  const std::vector<TokenInfo> &GetTokens() const { return Tokens; }
+
+  // Начало текста лексемы в буфере.
+  const char *GetText(const TokenInfo &token) const {
+    return Begin + token.Offset;
+  }
+
+private:
+  const char *Begin;
+  const char *End;
+  VariableTable &Symbols;
+  std::vector<TokenInfo> Tokens;
+  size_t Position;
+  bool Tokenized;
+
+  // Буфер для интернирования имен без лишних выделений памяти.
+  std::string Scratch;
+
+  void Emit(int kind, const char *start, const char *stop, int value) {
+    TokenInfo Token = {kind, (uint32_t)(start - Begin),
+                       (uint32_t)(stop - start), value};
+    Tokens.push_back(Token);
+  }
+};
@@ -0,0 +1,164 @@
+#include "bytecode.h"
+#include "ast.h"
+#include "toystd.h"
+#include <utility>
+
+// Трансляция выражений
+// =====================================================================
+
+void ConstNode::Lower(BytecodeBuilder &b, unsigned dst) {
+  b.Emit(OP_CONST, dst, Val);
+}
+
+void VarNode::Lower(BytecodeBuilder &b, unsigned dst) {
+  b.Emit(OP_MOVE, dst, Id);
+}
+
+void SumNode::Lower(BytecodeBuilder &b, unsigned dst) {
+  // В корректной программе слагаемые суммы - всегда переменные
+  // (константы сложены в свободный член при разборе), поэтому
+  // они прибавляются прямо из своих ячеек.
+  if (NumTerms == 0) {
+    b.Emit(OP_CONST, dst, Constant);
+    return;
+  }
+
+  Terms[0].Expr->Lower(b, dst);
+  if (Terms[0].Op == SUB) {
+    b.Emit(OP_NEG, dst);
+  }
+
+  for (size_t i = 1; i < NumTerms; ++i) {
+    VarNode *Var = static_cast<VarNode *>(Terms[i].Expr);
+    b.Emit(Terms[i].Op == ADD ? OP_ADD : OP_SUB, dst, Var->GetId());
+  }
+
+  if (Constant != 0) {
+    b.Emit(OP_ADDK, dst, Constant);
+  }
+}
+
+// Трансляция операторов
+// =====================================================================
+
+void SeqNode::Lower(BytecodeBuilder &b) {
+  for (auto stmt : Statements) {
+    stmt->Lower(b);
+  }
+}
+
+void AssignNode::Lower(BytecodeBuilder &b) {
+  int Val;
+  if (RHS->GetConstValue(Val)) {
+    b.Emit(OP_CONST, Id, Val);
+    return;
+  }
+
+  // Сумма может читать саму переменную (x = y - x), поэтому
+  // вычисляется во временном регистре.
+  RHS->Lower(b, b.GetTemp());
+  b.Emit(OP_MOVE, Id, b.GetTemp());
+}
+
+void IfNode::Lower(BytecodeBuilder &b) {
+  Cond->Lower(b, b.GetTemp());
+
+  BytecodeOpcode Jump = OP_JUMP_UNLESS_POSITIVE;
+  if (Op == NEGATIVE) {
+    Jump = OP_JUMP_UNLESS_NEGATIVE;
+  } else if (Op == ZERO) {
+    Jump = OP_JUMP_UNLESS_ZERO;
+  }
+
+  size_t ToElse = b.Emit(Jump, b.GetTemp());
+  Then->Lower(b);
+
+  if (Else != nullptr) {
+    size_t ToEnd = b.Emit(OP_JUMP, 0);
+    b.Patch(ToElse, b.Here());
+    Else->Lower(b);
+    b.Patch(ToEnd, b.Here());
+  } else {
+    b.Patch(ToElse, b.Here());
+  }
+}
+
+void PrintNode::Lower(BytecodeBuilder &b) {
+  RHS->Lower(b, b.GetTemp());
+  b.Emit(OP_PRINT, b.GetTemp());
+}
+
+void InputNode::Lower(BytecodeBuilder &b) { b.Emit(OP_INPUT, Id); }
+
+void LowerProgram(StmtNode *Prog, size_t numVars, BytecodeProgram &out) {
+  BytecodeBuilder Builder(numVars);
+  Prog->Lower(Builder);
+  Builder.Emit(OP_HALT, 0);
+  out = std::move(Builder.GetProgram());
+}
+
+// Интерпретатор
+// =====================================================================
+
+void RunBytecode(const BytecodeProgram &program) {
+  // Неинициализированные переменные считаются равными нулю.
+  std::vector<int32_t> Registers(program.NumRegisters, 0);
+  int32_t *R = Registers.data();
+  const BytecodeInstruction *Code = program.Code.data();
+  const BytecodeInstruction *I = Code;
+
+  while (true) {
+    switch (I->Op) {
+    case OP_CONST:
+      R[I->A] = I->B;
+      break;
+    case OP_MOVE:
+      R[I->A] = R[I->B];
+      break;
+    case OP_ADD:
+      R[I->A] = (int32_t)((uint32_t)R[I->A] + (uint32_t)R[I->B]);
+      break;
+    case OP_SUB:
+      R[I->A] = (int32_t)((uint32_t)R[I->A] - (uint32_t)R[I->B]);
+      break;
+    case OP_NEG:
+      R[I->A] = (int32_t)(0u - (uint32_t)R[I->A]);
+      break;
+    case OP_ADDK:
+      R[I->A] = (int32_t)((uint32_t)R[I->A] + (uint32_t)I->B);
+      break;
+    case OP_INPUT:
+      R[I->A] = builtin_input();
+      break;
+    case OP_PRINT:
+      builtin_print(R[I->A]);
+      break;
+    case OP_JUMP:
+      I = Code + I->B;
+      continue;
+    case OP_JUMP_UNLESS_NEGATIVE:
+      if (!(R[I->A] < 0)) {
+        I = Code + I->B;
+        continue;
+      }
+      break;
+    case OP_JUMP_UNLESS_ZERO:
+      if (R[I->A] != 0) {
+        I = Code + I->B;
+        continue;
+      }
+      break;
+    case OP_JUMP_UNLESS_POSITIVE:
+      if (!(R[I->A] > 0)) {
+        I = Code + I->B;
+        continue;
+      }
+      break;
+    case OP_HALT:
+      builtin_flush();
+      return;
+    }
+
+    ++I;
+  }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class StmtNode;
+
+// Байт-код для непосредственного исполнения программ без LLVM.
+//
+// Регистры - это ячейки переменных (номера из VariableTable) и один
+// временный регистр после них, в котором вычисляются суммы и условия.
+// Все вычисления ведутся по модулю 2^32, как и в сгенерированном коде.
+enum BytecodeOpcode : uint8_t {
+  OP_CONST, // R[A] = B
+  OP_MOVE,  // R[A] = R[B]
+  OP_ADD,   // R[A] += R[B]
+  OP_SUB,   // R[A] -= R[B]
+  OP_NEG,   // R[A] = -R[A]
+  OP_ADDK,  // R[A] += B
+  OP_INPUT, // R[A] = builtin_input()
+  OP_PRINT, // builtin_print(R[A])
+
+  // Переходы: B - номер инструкции назначения.
+  OP_JUMP,
+  OP_JUMP_UNLESS_NEGATIVE, // if (!(R[A] < 0)) goto B
+  OP_JUMP_UNLESS_ZERO,     // if (!(R[A] == 0)) goto B
+  OP_JUMP_UNLESS_POSITIVE, // if (!(R[A] > 0)) goto B
+
+  OP_HALT
+};
+
+struct BytecodeInstruction {
+  BytecodeOpcode Op;
+  uint32_t A;
+  int32_t B;
+};
+
+struct BytecodeProgram {
+  std::vector<BytecodeInstruction> Code;
+  unsigned NumRegisters;
+};
+
+// Построитель байт-кода, используемый методами Lower узлов дерева.
+class BytecodeBuilder {
+  BytecodeProgram Program;
+  unsigned Temp;
+
+public:
+  BytecodeBuilder(size_t numVars) : Temp(numVars) {
+    Program.NumRegisters = numVars + 1;
+  }
+
+  // Временный регистр для сумм и условий.
+  unsigned GetTemp() const { return Temp; }
+
+  // Добавление инструкции; возвращает ее номер.
+  size_t Emit(BytecodeOpcode op, uint32_t a, int32_t b = 0) {
+    BytecodeInstruction I = {op, a, b};
+    Program.Code.push_back(I);
+    return Program.Code.size() - 1;
+  }
+
+  // Номер следующей инструкции - цель для переходов вперед.
+  size_t Here() const { return Program.Code.size(); }
+
+  // Установка цели перехода у ранее добавленной инструкции.
+  void Patch(size_t at, size_t target) { Program.Code[at].B = target; }
+
+  BytecodeProgram &GetProgram() { return Program; }
+};
+
+// Трансляция всей программы в байт-код.
+void LowerProgram(StmtNode *Prog, size_t numVars, BytecodeProgram &out);
+
+// Исполнение байт-кода. Ввод и вывод - через builtin_input и
+// builtin_print стандартной библиотеки (toystd.c).
+void RunBytecode(const BytecodeProgram &program);
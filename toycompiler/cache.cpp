@@ -0,0 +1,241 @@
+#include "cache.h"
+#include "runtime.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+#include <llvm/Config/llvm-config.h>
+
+// Ключи
+// =====================================================================
+
+// Два независимых 64-битных хэша (FNV-1a и мультипликативный
+// с перемешиванием) дают 128-битный ключ. Хэши не криптографические:
+// кэш защищает от случайных совпадений, а не от подделки.
+class KeyHasher {
+  uint64_t A;
+  uint64_t B;
+
+public:
+  KeyHasher() : A(0xcbf29ce484222325ULL), B(0x9e3779b97f4a7c15ULL) {}
+
+  void Add(unsigned char c) {
+    A = (A ^ c) * 0x100000001b3ULL;
+    B = (B ^ c) * 0xff51afd7ed558ccdULL;
+    B ^= B >> 29;
+  }
+
+  void Add(const std::string &s) {
+    for (char c : s) {
+      Add((unsigned char)c);
+    }
+  }
+
+  std::string Hex() const {
+    static const char Digits[] = "0123456789abcdef";
+    std::string Out;
+    for (uint64_t V : {A, B}) {
+      for (int Shift = 60; Shift >= 0; Shift -= 4) {
+        Out += Digits[(V >> Shift) & 0xF];
+      }
+    }
+
+    return Out;
+  }
+};
+
+// Хэш встроенного биткода стандартной библиотеки. Считается один раз:
+// биткод не меняется, пока работает компилятор.
+static const std::string &RuntimeHash() {
+  static const std::string Hash = [] {
+    size_t Size;
+    const char *Bitcode = GetRuntimeBitcode(Size);
+    KeyHasher H;
+    for (size_t i = 0; i < Size; ++i) {
+      H.Add((unsigned char)Bitcode[i]);
+    }
+    return H.Hex();
+  }();
+
+  return Hash;
+}
+
+std::string CompileCache::MakeKey(const char *begin, const char *end,
+                                  const std::string &config) {
+  KeyHasher H;
+  H.Add(TOYCOMPILER_VERSION " LLVM " LLVM_VERSION_STRING);
+  H.Add('\0');
+  H.Add(RuntimeHash());
+  H.Add('\0');
+  H.Add(config);
+  H.Add('\0');
+
+  // Нормализация: серии пробелов и табуляций становятся одним
+  // пробелом, пробелы в начале и конце строк и пустые строки
+  // отбрасываются, '\r' считается переводом строки.
+  bool LineStart = true;
+  bool PendingSpace = false;
+  for (const char *p = begin; p != end; ++p) {
+    char c = *p;
+    if (c == ' ' || c == '\t') {
+      PendingSpace = !LineStart;
+    } else if (c == '\n' || c == '\r') {
+      if (!LineStart) {
+        H.Add('\n');
+      }
+      LineStart = true;
+      PendingSpace = false;
+    } else {
+      if (PendingSpace) {
+        H.Add(' ');
+      }
+      H.Add((unsigned char)c);
+      LineStart = false;
+      PendingSpace = false;
+    }
+  }
+
+  return H.Hex();
+}
+
+// Файлы
+// =====================================================================
+
+static bool CopyFile(const std::string &from, const std::string &to) {
+  int In = open(from.c_str(), O_RDONLY);
+  if (In < 0) {
+    return false;
+  }
+
+  int Out = to == "-" ? STDOUT_FILENO
+                      : open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (Out < 0) {
+    close(In);
+    return false;
+  }
+
+  char Buffer[64 * 1024];
+  bool Ok = true;
+  ssize_t Count;
+  while ((Count = read(In, Buffer, sizeof(Buffer))) > 0) {
+    for (ssize_t Done = 0; Done < Count;) {
+      ssize_t Written = write(Out, Buffer + Done, Count - Done);
+      if (Written < 0) {
+        if (errno == EINTR)
+          continue;
+        Ok = false;
+        break;
+      }
+      Done += Written;
+    }
+
+    if (!Ok)
+      break;
+  }
+
+  Ok = Ok && Count == 0;
+  close(In);
+  if (Out != STDOUT_FILENO) {
+    Ok = close(Out) == 0 && Ok;
+  }
+
+  return Ok;
+}
+
+bool CompileCache::Init(std::string &error) {
+  if (mkdir(Dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    error = Dir + ": " + strerror(errno);
+    return false;
+  }
+
+  return true;
+}
+
+bool CompileCache::Lookup(const std::string &key, const std::string &output) {
+  std::string Path = Dir + "/" + key;
+  if (access(Path.c_str(), R_OK) != 0 || !CopyFile(Path, output)) {
+    ++Misses;
+    return false;
+  }
+
+  // Время изменения служит временем последнего использования
+  // при вытеснении записей.
+  utime(Path.c_str(), nullptr);
+  ++Hits;
+  return true;
+}
+
+std::string CompileCache::TempPath() {
+  return Dir + "/tmp." + std::to_string(getpid()) + "." +
+         std::to_string(TempCounter++);
+}
+
+bool CompileCache::Store(const std::string &key, const std::string &tempPath,
+                         const std::string &output) {
+  std::string Path = Dir + "/" + key;
+  if (rename(tempPath.c_str(), Path.c_str()) != 0) {
+    unlink(tempPath.c_str());
+    return false;
+  }
+
+  ++Stores;
+  return CopyFile(Path, output);
+}
+
+void CompileCache::Trim() {
+  struct Entry {
+    std::string Path;
+    uint64_t Used;
+    uint64_t Size;
+  };
+
+  DIR *D = opendir(Dir.c_str());
+  if (D == nullptr) {
+    return;
+  }
+
+  std::vector<Entry> Entries;
+  uint64_t Total = 0;
+  while (struct dirent *E = readdir(D)) {
+    // Временные файлы принадлежат идущим компиляциям.
+    if (E->d_name[0] == '.' || strncmp(E->d_name, "tmp.", 4) == 0) {
+      continue;
+    }
+
+    Entry Item;
+    Item.Path = Dir + "/" + E->d_name;
+    struct stat St;
+    if (stat(Item.Path.c_str(), &St) != 0 || !S_ISREG(St.st_mode)) {
+      continue;
+    }
+
+    Item.Used = (uint64_t)St.st_mtim.tv_sec * 1000000000 + St.st_mtim.tv_nsec;
+    Item.Size = St.st_size;
+    Total += Item.Size;
+    Entries.push_back(Item);
+  }
+  closedir(D);
+
+  if (Total <= MaxBytes) {
+    return;
+  }
+
+  std::sort(Entries.begin(), Entries.end(),
+            [](const Entry &a, const Entry &b) { return a.Used < b.Used; });
+  for (auto &entry : Entries) {
+    if (Total <= MaxBytes) {
+      break;
+    }
+
+    if (unlink(entry.Path.c_str()) == 0) {
+      Total -= entry.Size;
+      ++Evicted;
+    }
+  }
+}
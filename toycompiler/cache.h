@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Версия компилятора для ключей кэша. Ее нужно увеличивать при любом
+// изменении генератора кода, иначе кэш вернет результаты старой версии.
+// Изменения стандартной библиотеки учитываются сами: ее биткод входит
+// в ключ.
+#define TOYCOMPILER_VERSION "toycompiler-7"
+
+// Кэш результатов компиляции на диске с адресацией по содержимому.
+//
+// Ключ - хэш нормализованного исходного текста и параметров компиляции
+// (уровня оптимизации, вида результата, версии компилятора и биткода
+// встроенной стандартной библиотеки). Каждый
+// результат хранится в отдельном файле <dir>/<ключ>. Запись атомарна:
+// файл сначала создается под временным именем, а затем переименовывается,
+// поэтому кэш можно использовать из нескольких потоков и процессов.
+// Размер ограничен: при превышении удаляются давно не использованные
+// записи.
+class CompileCache {
+  std::string Dir;
+  uint64_t MaxBytes;
+  std::atomic<unsigned> Hits;
+  std::atomic<unsigned> Misses;
+  std::atomic<unsigned> Stores;
+  std::atomic<unsigned> TempCounter;
+  unsigned Evicted;
+
+public:
+  CompileCache(const std::string &dir, uint64_t maxBytes)
+      : Dir(dir), MaxBytes(maxBytes), Hits(0), Misses(0), Stores(0),
+        TempCounter(0), Evicted(0) {}
+
+  // Создание каталога кэша, если его еще нет.
+  bool Init(std::string &error);
+
+  // Ключ для исходного текста и строки параметров компиляции.
+  // Текст нормализуется: пробелы, табуляции и пустые строки,
+  // не влияющие на разбор, в ключ не попадают.
+  static std::string MakeKey(const char *begin, const char *end,
+                             const std::string &config);
+
+  // Поиск результата по ключу и копирование его в output
+  // ("-" - stdout). Возвращает true при попадании.
+  bool Lookup(const std::string &key, const std::string &output);
+
+  // Уникальное имя временного файла в каталоге кэша.
+  std::string TempPath();
+
+  // Помещение готового результата из временного файла в кэш
+  // и копирование его в output.
+  bool Store(const std::string &key, const std::string &tempPath,
+             const std::string &output);
+
+  // Удаление давно не использованных записей сверх ограничения размера.
+  void Trim();
+
+  unsigned GetHits() const { return Hits; }
+  unsigned GetMisses() const { return Misses; }
+  unsigned GetStores() const { return Stores; }
+  unsigned GetEvicted() const { return Evicted; }
+};
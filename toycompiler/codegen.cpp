@@ -1,14 +1,21 @@
 #include "ast.h"
+#include "batch.h"
+#include "flatast.h"
 #include "generator.h"
+#include "runtime.h"
+#include "stats.h"
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/PassManager.h>
 #include <llvm/Analysis/Passes.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Transforms/Scalar.h>
 #include <algorithm>
 #include <iostream>
@@ -18,35 +25,40 @@ using namespace llvm;
 // Генерация кода
 // ===========================================
 
-Value *ConstNode::Generate(GeneratorState *) {
-  return ConstantInt::get(getGlobalContext(), APInt(32, Val));
+Value *ConstNode::Generate(GeneratorState *gen) {
+  return ConstantInt::get(gen->GetContext(), APInt(32, Val));
 }
 
 Value *VarNode::Generate(GeneratorState *gen) {
-  Value *V = gen->GetVar(Name);
-  // Так как мы заранее создаем все переменные, переменная
-  // обязательно должна быть, так что V != nullptr.
-  return gen->GetBuilder()->CreateLoad(V, Name.c_str());
+  return gen->ReadVar(Id, Name);
 }
 
-Value *BinaryNode::Generate(GeneratorState *gen) {
-  Value *L = LHS->Generate(gen);
-  Value *R = RHS->Generate(gen);
-  if (L == nullptr || R == nullptr) {
-    return nullptr;
+Value *SumNode::Generate(GeneratorState *gen) {
+  IRBuilder<> *Builder = gen->GetBuilder();
+  Value *Sum = nullptr;
+
+  // Слагаемые обходятся циклом, а не рекурсией.
+  for (size_t i = 0; i < NumTerms; ++i) {
+    Value *V = Terms[i].Expr->Generate(gen);
+    if (V == nullptr) {
+      return nullptr;
+    }
+
+    if (Sum == nullptr) {
+      Sum = Terms[i].Op == ADD ? V : Builder->CreateNeg(V);
+    } else if (Terms[i].Op == ADD) {
+      Sum = Builder->CreateAdd(Sum, V);
+    } else {
+      Sum = Builder->CreateSub(Sum, V);
+    }
   }
 
-  Value *V = nullptr;
-  switch (Op) {
-  case ADD:
-    V = gen->GetBuilder()->CreateAdd(L, R);
-    break;
-  case SUB:
-    V = gen->GetBuilder()->CreateSub(L, R);
-    break;
+  Value *C = ConstantInt::get(gen->GetContext(), APInt(32, Constant, true));
+  if (Sum == nullptr) {
+    return C;
   }
 
-  return V;
+  return Constant != 0 ? Builder->CreateAdd(Sum, C) : Sum;
 }
 
 // Генерация кода для операторов
@@ -58,165 +70,736 @@ void SeqNode::Generate(GeneratorState *gen) {
 }
 
 void AssignNode::Generate(GeneratorState *gen) {
-  AllocaInst *lhs = gen->GetVar(Name);
   Value *rhs = RHS->Generate(gen);
-  gen->GetBuilder()->CreateStore(rhs, lhs);
+  gen->WriteVar(Id, rhs);
 }
 
 void IfNode::Generate(GeneratorState *gen) {
+  GeneratorState::IfState state;
+  gen->BeginIf(Op, this->Cond->Generate(gen), state);
+  Then->Generate(gen);
+  gen->BeginElse(state);
+  if (Else != nullptr) {
+    Else->Generate(gen);
+  }
+  gen->EndIf(state);
+}
+
+void PrintNode::Generate(GeneratorState *gen) {
+  Value *rhs = RHS->Generate(gen);
+  gen->Builder->CreateCall(gen->BuiltinPrint, rhs);
+}
+
+void InputNode::Generate(GeneratorState *gen) {
+  CallInst *val = gen->Builder->CreateCall(gen->BuiltinInput);
+  gen->WriteVar(Id, val);
+}
+
+// Состояние генератора
+void GeneratorState::CreatePrototypes(bool withMain) {
+  BuiltinPrint = Function::Create(
+      FunctionType::get(Type::getVoidTy(Context),
+                        std::vector<Type *>(1, Type::getInt32Ty(Context)),
+                        false),
+      Function::ExternalLinkage, "builtin_print", MainModule);
+
+  BuiltinInput =
+      Function::Create(FunctionType::get(Type::getInt32Ty(Context),
+                                         std::vector<Type *>(), false),
+                       Function::ExternalLinkage, "builtin_input", MainModule);
+
+  Main = Current = nullptr;
+  if (!withMain) {
+    return;
+  }
+
+  Main = Current =
+      Function::Create(FunctionType::get(Type::getVoidTy(Context),
+                                         std::vector<Type *>(), false),
+                       Function::ExternalLinkage, "main", MainModule);
+  BasicBlock *BB = BasicBlock::Create(Context, "entry", Main);
+  Builder->SetInsertPoint(BB);
+}
+
+AllocaInst *GeneratorState::CreateVar(unsigned id) {
+  assert(Symbols != nullptr && "Variable was not allocated");
+
+  // Все ячейки живут в начале входного блока функции, где их найдет
+  // mem2reg.
+  BasicBlock *Root = &Current->getEntryBlock();
+  IRBuilder<> VarBuilder(Root, Root->begin());
+
+  if (id >= Variables.size()) {
+    Variables.resize(Symbols->Size(), nullptr);
+  }
+
+  AllocaInst *Var = VarBuilder.CreateAlloca(Type::getInt32Ty(Context), 0,
+                                            Symbols->GetName(id));
+
+  // Внутри части программы начальное значение берется из общего кадра.
+  if (Frame != nullptr) {
+    Value *Slot = VarBuilder.CreateConstGEP1_32(Frame, id);
+    VarBuilder.CreateStore(VarBuilder.CreateLoad(Slot), Var);
+  }
+
+  AddVar(id, Var);
+  return Var;
+}
+
+void GeneratorState::AddVariables(const VariableTable &Vars) {
+  if (DirectSSA) {
+    Symbols = &Vars;
+    GrowValues(Vars.Size());
+    return;
+  }
+
+  BasicBlock *Root = GetMainEntryBlock();
+  IRBuilder<> VarBuilder(Root, Root->begin());
+
+  Variables.resize(Vars.Size(), nullptr);
+  for (unsigned id = 0; id < Vars.Size(); ++id) {
+    AddVar(id, VarBuilder.CreateAlloca(Type::getInt32Ty(Context), 0,
+                                       Vars.GetName(id)));
+  }
+}
+
+void GeneratorState::GrowValues(unsigned id) {
+  if (id < Values.size()) {
+    return;
+  }
+
+  size_t Size = Symbols != nullptr ? Symbols->Size() : 0;
+  Size = std::max<size_t>(Size, id + 1);
+  Values.resize(Size, nullptr);
+  InitialValues.resize(Size, nullptr);
+  MergeValues.resize(Size, nullptr);
+  Marks.resize(Size, 0);
+}
+
+Value *GeneratorState::InitialValue(unsigned id) {
+  if (InitialValues[id] != nullptr) {
+    return InitialValues[id];
+  }
+
+  // Внутри части начальное значение читается из кадра во входном
+  // блоке, откуда оно доступно во всей функции.
+  Value *Initial;
+  if (Frame != nullptr) {
+    BasicBlock *Root = &Current->getEntryBlock();
+    IRBuilder<> EntryBuilder(Root, Root->begin());
+    Value *Slot = EntryBuilder.CreateConstGEP1_32(Frame, id);
+    Initial = EntryBuilder.CreateLoad(Slot);
+  } else {
+    Initial = UndefValue::get(Type::getInt32Ty(Context));
+  }
+
+  InitialValues[id] = Initial;
+  return Initial;
+}
+
+void GeneratorState::SetValue(unsigned id, Value *value) {
+  // Вне ветвей откатывать нечего, и журнал не растет.
+  if (BranchDepth > 0) {
+    Trail.push_back(std::make_pair(id, Values[id]));
+  }
+
+  Values[id] = value;
+}
+
+Value *GeneratorState::ReadVar(unsigned id, const std::string &name) {
+  if (!DirectSSA) {
+    return Builder->CreateLoad(GetVar(id), name);
+  }
+
+  GrowValues(id);
+  if (Values[id] == nullptr) {
+    // Начальное значение годится везде, поэтому в журнал не попадает.
+    Values[id] = InitialValue(id);
+  }
+
+  return Values[id];
+}
+
+void GeneratorState::WriteVar(unsigned id, Value *value) {
+  if (!DirectSSA) {
+    Builder->CreateStore(value, GetVar(id));
+    return;
+  }
+
+  GrowValues(id);
+  SetValue(id, value);
+}
+
+void GeneratorState::BeginIf(unsigned op, Value *arg, IfState &state) {
   Value *cond;
-  Value *arg = this->Cond->Generate(gen);
-  Value *zero = ConstantInt::get(gen->GetContext(), APInt(32, 0));
+  Value *zero = ConstantInt::get(Context, APInt(32, 0));
 
-  if (Op == NEGATIVE) {
-    cond = gen->Builder->CreateICmpSLT(arg, zero);
-  } else if (Op == ZERO) {
-    cond = gen->Builder->CreateICmpEQ(arg, zero);
+  if (op == NEGATIVE) {
+    cond = Builder->CreateICmpSLT(arg, zero);
+  } else if (op == ZERO) {
+    cond = Builder->CreateICmpEQ(arg, zero);
   } else {
-    cond = gen->Builder->CreateICmpSGT(arg, zero);
+    cond = Builder->CreateICmpSGT(arg, zero);
   }
 
-  BasicBlock *t = BasicBlock::Create(gen->GetContext(), "then", gen->Main);
-  BasicBlock *e = BasicBlock::Create(gen->GetContext(), "else", gen->Main);
-  BasicBlock *m = BasicBlock::Create(gen->GetContext(), "merge", gen->Main);
+  BasicBlock *t = BasicBlock::Create(Context, "then", Current);
+  state.Else = BasicBlock::Create(Context, "else", Current);
+  state.Merge = BasicBlock::Create(Context, "merge", Current);
 
-  gen->Builder->CreateCondBr(cond, t, e);
+  state.Branch = NextBranch();
+  Builder->CreateCondBr(cond, t, state.Else, BranchWeights(state.Branch));
 
   // Блок then
-  gen->Builder->SetInsertPoint(t);
-  Then->Generate(gen);
-  // Then = gen->Builder->GetInsertBlock();
-  gen->Builder->CreateBr(m);
+  state.Mark = BeginBranch();
+  Builder->SetInsertPoint(t);
+  CountBranch(state.Branch, true);
+}
+
+void GeneratorState::BeginElse(IfState &state) {
+  state.ThenEnd = Builder->GetInsertBlock();
+  Builder->CreateBr(state.Merge);
+  EndBranch(state.Mark, state.ThenValues);
 
   // Блок else
-  gen->Builder->SetInsertPoint(e);
-  if (Else != nullptr) {
-    Else->Generate(gen);
-  }
-  // Else = gen->Builder->GetInsertBlock();
-  gen->Builder->CreateBr(m);
+  state.Mark = BeginBranch();
+  Builder->SetInsertPoint(state.Else);
+  CountBranch(state.Branch, false);
+}
+
+void GeneratorState::EndIf(IfState &state) {
+  BasicBlock *elseEnd = Builder->GetInsertBlock();
+  ValueList elseValues;
+  Builder->CreateBr(state.Merge);
+  EndBranch(state.Mark, elseValues);
 
   // Слияние ветвей
-  gen->Builder->SetInsertPoint(m);
+  Builder->SetInsertPoint(state.Merge);
+  MergeBranches(state.ThenEnd, state.ThenValues, elseEnd, elseValues);
 }
 
-void PrintNode::Generate(GeneratorState *gen) {
-  Value *rhs = RHS->Generate(gen);
-  gen->Builder->CreateCall(gen->BuiltinPrint, rhs);
+size_t GeneratorState::BeginBranch() {
+  ++BranchDepth;
+  return Trail.size();
 }
 
-void InputNode::Generate(GeneratorState *gen) {
-  CallInst *val = gen->Builder->CreateCall(gen->BuiltinInput);
-  gen->Builder->CreateStore(val, gen->GetVar(Name));
+void GeneratorState::EndBranch(size_t mark, ValueList &changed) {
+  changed.clear();
+
+  // Каждая переменная попадает в список один раз, с последним значением.
+  ++Epoch;
+  for (size_t i = mark; i < Trail.size(); ++i) {
+    unsigned Id = Trail[i].first;
+    if (Marks[Id] != Epoch) {
+      Marks[Id] = Epoch;
+      changed.push_back(std::make_pair(Id, Values[Id]));
+    }
+  }
+
+  while (Trail.size() > mark) {
+    Values[Trail.back().first] = Trail.back().second;
+    Trail.pop_back();
+  }
+
+  --BranchDepth;
 }
 
-// Получение списка переменных
-// ------------------------------------------------------------------
-std::set<std::string> ConstNode::GetVariables() {
-  return std::set<std::string>();
+void GeneratorState::MergeBranches(BasicBlock *thenEnd,
+                                   const ValueList &thenValues,
+                                   BasicBlock *elseEnd,
+                                   const ValueList &elseValues) {
+  // Значение переменной, не тронутой в ветви, - общее значение
+  // до условного оператора.
+  auto Before = [this](unsigned id) {
+    return Values[id] != nullptr ? Values[id] : InitialValue(id);
+  };
+
+  auto Merge = [&](unsigned id, Value *thenValue, Value *elseValue) {
+    if (thenValue == elseValue) {
+      SetValue(id, thenValue);
+      return;
+    }
+
+    PHINode *Phi = Builder->CreatePHI(
+        Type::getInt32Ty(Context), 2,
+        Symbols != nullptr ? Symbols->GetName(id) : std::string());
+    Phi->addIncoming(thenValue, thenEnd);
+    Phi->addIncoming(elseValue, elseEnd);
+    SetValue(id, Phi);
+  };
+
+  for (auto &entry : elseValues) {
+    MergeValues[entry.first] = entry.second;
+  }
+
+  ++Epoch;
+  for (auto &entry : thenValues) {
+    unsigned Id = entry.first;
+    Marks[Id] = Epoch;
+    Value *Other = MergeValues[Id] != nullptr ? MergeValues[Id] : Before(Id);
+    Merge(Id, entry.second, Other);
+  }
+
+  for (auto &entry : elseValues) {
+    unsigned Id = entry.first;
+    if (Marks[Id] != Epoch) {
+      Merge(Id, Before(Id), entry.second);
+    }
+    MergeValues[Id] = nullptr;
+  }
 }
 
-std::set<std::string> VarNode::GetVariables() {
-  std::set<std::string> Vars;
-  Vars.insert(Name);
-  return Vars;
+void GeneratorState::Optimize(unsigned level) {
+  // -O0: код остается таким, как его построил генератор.
+  if (level == 0) {
+    return;
+  }
+
+  // -O1: быстрый набор проходов над каждой функцией программы
+  // (до -O2/-O3 это был единственный конвейер компилятора).
+  if (level == 1) {
+    FunctionPassManager fpm(MainModule);
+    fpm.add(createBasicAliasAnalysisPass());
+    fpm.add(createPromoteMemoryToRegisterPass());
+    fpm.add(createInstructionCombiningPass());
+    fpm.add(createReassociatePass());
+    fpm.add(createGVNPass());
+    fpm.add(createCFGSimplificationPass());
+    fpm.doInitialization();
+    for (auto &F : *MainModule) {
+      if (!F.isDeclaration()) {
+        fpm.run(F);
+      }
+    }
+    fpm.doFinalization();
+    return;
+  }
+
+  // -O2, -O3: стандартный конвейер LLVM для всего модуля,
+  // включая межпроцедурные проходы и встраивание функций.
+  PassManagerBuilder Builder;
+  Builder.OptLevel = level;
+  Builder.SizeLevel = 0;
+  Builder.Inliner = createFunctionInliningPass(level > 2 ? 275 : 225);
+  Builder.LoopVectorize = true;
+  Builder.SLPVectorize = level > 2;
+
+  FunctionPassManager fpm(MainModule);
+  Builder.populateFunctionPassManager(fpm);
+  fpm.doInitialization();
+  for (auto &F : *MainModule) {
+    if (!F.isDeclaration()) {
+      fpm.run(F);
+    }
+  }
+  fpm.doFinalization();
+
+  PassManager mpm;
+  Builder.populateModulePassManager(mpm);
+  mpm.run(*MainModule);
 }
 
-std::set<std::string> BinaryNode::GetVariables() {
-  auto Vars = LHS->GetVariables();
-  auto RHSVars = RHS->GetVariables();
-  Vars.insert(RHSVars.begin(), RHSVars.end());
-  return Vars;
+void GeneratorState::CreateFrame(size_t numVars) {
+  BasicBlock *Root = GetMainEntryBlock();
+  IRBuilder<> FrameBuilder(Root, Root->begin());
+  MainFrame = FrameBuilder.CreateAlloca(
+      Type::getInt32Ty(Context),
+      ConstantInt::get(Type::getInt32Ty(Context), numVars > 0 ? numVars : 1),
+      "frame");
+  Frame = MainFrame;
 }
 
-std::set<std::string> SeqNode::GetVariables() {
-  std::set<std::string> Vars;
-  for (auto stmt : Statements) {
-    auto ThisStmtVars = stmt->GetVariables();
-    Vars.insert(ThisStmtVars.begin(), ThisStmtVars.end());
+void GeneratorState::SetFrameSize(size_t numVars) {
+  size_t Size = numVars > 0 ? numVars : 1;
+  MainFrame->setOperand(0, ConstantInt::get(Type::getInt32Ty(Context), Size));
+}
+
+Function *GeneratorState::CreateChunk(const std::string &name, bool shared) {
+  Type *FrameType = Type::getInt32PtrTy(Context);
+  Function *Chunk = Function::Create(
+      FunctionType::get(Type::getVoidTy(Context), FrameType, false),
+      shared ? Function::ExternalLinkage : Function::InternalLinkage, name,
+      MainModule);
+  if (shared) {
+    Chunk->setVisibility(GlobalValue::HiddenVisibility);
   }
 
-  return Vars;
+  // Часть вызывается один раз, и без запрета встраивания оптимизатор
+  // собрал бы все части обратно в одну огромную main.
+  Chunk->addFnAttr(Attribute::NoInline);
+  Chunk->setDoesNotAlias(1);
+  Chunk->setDoesNotCapture(1);
+  return Chunk;
 }
 
-std::set<std::string> AssignNode::GetVariables() {
-  auto Vars = RHS->GetVariables();
-  Vars.insert(Name);
-  return Vars;
+void GeneratorState::BeginChunk(Function *chunk) {
+  ResumeBlock = Builder->GetInsertBlock();
+  Current = chunk;
+  Frame = chunk->arg_begin();
+  Variables.clear();
+  std::fill(Values.begin(), Values.end(), nullptr);
+  std::fill(InitialValues.begin(), InitialValues.end(), nullptr);
+
+  Builder->SetInsertPoint(BasicBlock::Create(Context, "entry", chunk));
 }
 
-std::set<std::string> IfNode::GetVariables() {
-  auto Vars = Cond->GetVariables();
-  auto ThenVars = Then->GetVariables();
-  Vars.insert(ThenVars.begin(), ThenVars.end());
+void GeneratorState::EndChunk() {
+  // Без ячеек в кадр возвращаются переменные, значение которых
+  // отличается от прочитанного из кадра.
+  for (unsigned id = 0; id < Values.size(); ++id) {
+    if (Values[id] != nullptr && Values[id] != InitialValues[id]) {
+      Builder->CreateStore(Values[id], Builder->CreateConstGEP1_32(Frame, id));
+    }
+  }
 
-  if (Else != nullptr) {
-    auto ElseVars = Else->GetVariables();
-    Vars.insert(ElseVars.begin(), ElseVars.end());
+  // В кадр возвращаются только переменные, которым что-то присваивалось:
+  // кроме начальной записи из кадра у их ячеек есть другие записи.
+  for (unsigned id = 0; id < Variables.size(); ++id) {
+    AllocaInst *Var = Variables[id];
+    if (Var == nullptr) {
+      continue;
+    }
+
+    unsigned Stores = 0;
+    for (auto U = Var->use_begin(), E = Var->use_end(); U != E; ++U) {
+      StoreInst *Store = dyn_cast<StoreInst>(*U);
+      if (Store != nullptr && Store->getPointerOperand() == Var) {
+        ++Stores;
+      }
+    }
+
+    if (Stores > 1) {
+      Builder->CreateStore(Builder->CreateLoad(Var),
+                           Builder->CreateConstGEP1_32(Frame, id));
+    }
   }
 
-  return Vars;
+  Builder->CreateRetVoid();
+  Variables.clear();
+  Current = Main;
+  Frame = MainFrame;
+  if (ResumeBlock != nullptr) {
+    Builder->SetInsertPoint(ResumeBlock);
+  }
 }
 
-std::set<std::string> PrintNode::GetVariables() { return RHS->GetVariables(); }
+void GeneratorState::CallChunk(Function *chunk) {
+  Builder->CreateCall(chunk, MainFrame);
+}
+
+MDNode *GeneratorState::BranchWeights(unsigned branch) {
+  const BranchProfile *Profile = Profiling.Use;
+  if (Profile == nullptr || branch >= Profile->Counts.size()) {
+    return nullptr;
+  }
+
+  uint64_t Then = Profile->Counts[branch].first;
+  uint64_t Else = Profile->Counts[branch].second;
+  if (Then == 0 && Else == 0) {
+    return nullptr;
+  }
 
-std::set<std::string> InputNode::GetVariables() {
-  std::set<std::string> Vars;
-  Vars.insert(Name);
-  return Vars;
+  // Веса 32-битные, поэтому большие счетчики делятся с сохранением
+  // отношения. Единица, добавленная к весу, оставляет невыполнявшейся
+  // ветви малую, но не нулевую вероятность.
+  uint64_t Scale = std::max(Then, Else) / UINT32_MAX + 1;
+  return MDBuilder(Context).createBranchWeights(Then / Scale + 1,
+                                                Else / Scale + 1);
 }
 
-// Состояние генератора
-void GeneratorState::CreatePrototypes() {
-  BuiltinPrint = Function::Create(
-      FunctionType::get(
-          Type::getVoidTy(getGlobalContext()),
-          std::vector<Type *>(1, Type::getInt32Ty(getGlobalContext())), false),
-      Function::ExternalLinkage, "builtin_print", MainModule);
+void GeneratorState::CountBranch(unsigned branch, bool thenArm) {
+  if (Profiling.GeneratePath.empty()) {
+    return;
+  }
 
-  BuiltinInput =
-      Function::Create(FunctionType::get(Type::getInt32Ty(getGlobalContext()),
-                                         std::vector<Type *>(), false),
-                       Function::ExternalLinkage, "builtin_input", MainModule);
-  Main = Function::Create(FunctionType::get(Type::getVoidTy(getGlobalContext()),
-                                            std::vector<Type *>(), false),
-                          Function::ExternalLinkage, "main", MainModule);
-  BasicBlock *BB = BasicBlock::Create(getGlobalContext(), "entry", Main);
-  Builder->SetInsertPoint(BB);
+  Type *Int64 = Type::getInt64Ty(Context);
+  if (Counters == nullptr) {
+    Counters = new GlobalVariable(*MainModule, ArrayType::get(Int64, 0),
+                                  false, GlobalValue::ExternalLinkage,
+                                  nullptr, "toy.profile.counters.tmp");
+  }
+
+  Value *Slot =
+      Builder->CreateConstGEP2_64(Counters, 0, 2 * branch + (thenArm ? 0 : 1));
+  Value *Count = Builder->CreateLoad(Slot);
+  Builder->CreateStore(Builder->CreateAdd(Count, ConstantInt::get(Int64, 1)),
+                       Slot);
 }
 
-void GeneratorState::AddVariables(const std::set<std::string> &Variables) {
-  BasicBlock *Root = GetMainEntryBlock();
-  IRBuilder<> VarBuilder(Root, Root->begin());
+void GeneratorState::FinishProfile() {
+  const BranchProfile *Profile = Profiling.Use;
+  if (Profile != nullptr && Profile->Counts.size() != NumBranches) {
+    std::cerr << "warning: branch profile does not match the program, "
+                 "ignored" << std::endl;
+    for (auto &F : *MainModule) {
+      for (auto &BB : F) {
+        if (Instruction *Term = BB.getTerminator()) {
+          Term->setMetadata(LLVMContext::MD_prof, nullptr);
+        }
+      }
+    }
+  }
 
-  for (auto var : Variables) {
-    AddVar(var, VarBuilder.CreateAlloca(Type::getInt32Ty(getGlobalContext()),
-                                        0, var));
+  if (Profiling.GeneratePath.empty() || Main == nullptr) {
+    return;
   }
+
+  // Настоящий массив счетчиков заменяет временный во всех обращениях.
+  Type *Int32 = Type::getInt32Ty(Context);
+  Type *Int64 = Type::getInt64Ty(Context);
+  ArrayType *ArrayTy = ArrayType::get(Int64, 2 * NumBranches);
+  GlobalVariable *Array = new GlobalVariable(
+      *MainModule, ArrayTy, false, GlobalValue::InternalLinkage,
+      ConstantAggregateZero::get(ArrayTy), "toy.profile.counters");
+  if (Counters != nullptr) {
+    Counters->replaceAllUsesWith(
+        ConstantExpr::getBitCast(Array, Counters->getType()));
+    Counters->eraseFromParent();
+    Counters = nullptr;
+  }
+
+  std::vector<Type *> Params;
+  Params.push_back(Int64->getPointerTo());
+  Params.push_back(Int32);
+  Params.push_back(Type::getInt8PtrTy(Context));
+  Function *Register = Function::Create(
+      FunctionType::get(Type::getVoidTy(Context), Params, false),
+      Function::ExternalLinkage, "builtin_profile", MainModule);
+
+  // Счетчики регистрируются до первого оператора программы.
+  BasicBlock *Entry = GetMainEntryBlock();
+  IRBuilder<> EntryBuilder(Entry, Entry->getFirstInsertionPt());
+  EntryBuilder.CreateCall3(
+      Register, EntryBuilder.CreateConstGEP2_32(Array, 0, 0),
+      ConstantInt::get(Int32, NumBranches),
+      EntryBuilder.CreateGlobalStringPtr(Profiling.GeneratePath,
+                                         "toy.profile.path"));
 }
 
-void GeneratorState::Optimize()
-{
-  FunctionPassManager fpm(MainModule);
-  fpm.add(createBasicAliasAnalysisPass());
-  fpm.add(createPromoteMemoryToRegisterPass());
-  fpm.add(createInstructionCombiningPass());
-  fpm.add(createReassociatePass());
-  fpm.add(createGVNPass());
-  fpm.add(createCFGSimplificationPass());
-  fpm.doInitialization();
-  fpm.run(*Main);
+size_t GeneratorState::CountInstructions() const {
+  size_t Count = 0;
+  for (auto &F : *MainModule) {
+    for (auto &BB : F) {
+      Count += BB.size();
+    }
+  }
+
+  return Count;
 }
 
 // Реализация генератора
-Module *Generate(StmtNode *Prog) {
-  GeneratorState Gen;
+std::string ChunkName(size_t index) {
+  return "toy.chunk." + std::to_string(index);
+}
+
+void GenerateChunks(GeneratorState &Gen, const std::vector<StmtNode *> &Stmts,
+                    size_t Begin, size_t End, unsigned ChunkSize,
+                    bool Shared) {
+  assert(Begin % ChunkSize == 0 && "Partition must start at a chunk");
+
+  for (size_t First = Begin; First < End; First += ChunkSize) {
+    size_t Last = std::min(End, First + ChunkSize);
+    Function *Chunk = Gen.CreateChunk(ChunkName(First / ChunkSize), Shared);
+
+    Gen.BeginChunk(Chunk);
+    for (size_t i = First; i < Last; ++i) {
+      Stmts[i]->Generate(&Gen);
+    }
+    Gen.EndChunk();
+
+    if (Gen.Main != nullptr) {
+      Gen.CallChunk(Chunk);
+    }
+  }
+}
+
+Module *FinishModule(GeneratorState &Gen, unsigned OptLevel, bool WithRuntime,
+                     CompileStats *Stats, bool SharedRuntime) {
+  if (Gen.Main != nullptr) {
+    Gen.Builder->CreateRetVoid();
+  }
 
-  Gen.AddVariables(Prog->GetVariables());
-  Prog->Generate(&Gen);
-  Gen.Builder->CreateRetVoid();
-  Gen.Optimize();
+  if (Gen.Profiling.Enabled()) {
+    Gen.FinishProfile();
+  }
+
+  if (Stats != nullptr) {
+    Stats->SetCounter("ir_instructions_unoptimized", Gen.CountInstructions());
+  }
+
+  // Библиотека компонуется до оптимизации, чтобы встроенные функции
+  // можно было встроить в main.
+  if (WithRuntime) {
+    PhaseTimer Timer(Stats, "link_runtime");
+    std::string Error;
+    if (!LinkRuntime(Gen.GetMainModule(), SharedRuntime, Error)) {
+      std::cerr << "Runtime link error: " << Error << std::endl;
+      delete Gen.GetMainModule();
+      return nullptr;
+    }
+  }
+
+  {
+    PhaseTimer Timer(Stats, "optimize");
+    Gen.Optimize(OptLevel);
+  }
+
+  if (Stats != nullptr) {
+    Stats->SetCounter("ir_instructions", Gen.CountInstructions());
+  }
 
   return Gen.GetMainModule();
 }
 
+Module *Generate(LLVMContext &Context, StmtNode *Prog,
+                 const VariableTable &Vars, unsigned OptLevel,
+                 bool WithRuntime, unsigned ChunkSize, bool BatchEntry,
+                 bool DirectSSA, const ProfileOptions &Profiling,
+                 CompileStats *Stats) {
+  GeneratorState Gen(Context);
+  Gen.DirectSSA = DirectSSA;
+  Gen.Profiling = Profiling;
+
+  // Длинная программа делится на части по ChunkSize операторов.
+  SeqNode *Seq = dynamic_cast<SeqNode *>(Prog);
+  if (ChunkSize > 0 && Seq != nullptr &&
+      Seq->GetStatements().size() > ChunkSize) {
+    PhaseTimer Timer(Stats, "codegen");
+    const std::vector<StmtNode *> &Stmts = Seq->GetStatements();
+    Gen.AddVariablesLazily(Vars);
+    Gen.CreateFrame(Vars.Size());
+    GenerateChunks(Gen, Stmts, 0, Stmts.size(), ChunkSize, false);
+    if (Stats != nullptr) {
+      Stats->SetCounter("chunks", (Stmts.size() + ChunkSize - 1) / ChunkSize);
+    }
+  } else {
+    {
+      // Все переменные программы уже собраны в таблице при разборе.
+      PhaseTimer Timer(Stats, "variables");
+      Gen.AddVariables(Vars);
+    }
+
+    PhaseTimer Timer(Stats, "codegen");
+    Prog->Generate(&Gen);
+  }
+
+  // Пакетная точка входа дополняет обычную программу. Слабая main
+  // не мешает компоновать объектный файл с чужой main.
+  if (BatchEntry) {
+    PhaseTimer Timer(Stats, "batch_codegen");
+    GenerateBatchEntry(Gen, Prog, Vars);
+    Gen.Main->setLinkage(GlobalValue::WeakAnyLinkage);
+  }
+
+  return FinishModule(Gen, OptLevel, WithRuntime, Stats);
+}
+
+// Генерация по плоскому представлению
+// -------------------------------------------------------------
+
+static Value *GenerateFlatExpr(GeneratorState &Gen, const FlatAst &Ast,
+                               uint32_t Expr) {
+  IRBuilder<> *Builder = Gen.GetBuilder();
+  Value *Sum = nullptr;
+
+  const uint32_t *Term = Ast.Terms + Ast.ExprFirst[Expr];
+  const uint32_t *End = Ast.Terms + Ast.ExprFirst[Expr + 1];
+  for (; Term != End; ++Term) {
+    Value *V = Gen.ReadVar(FlatAst::TermVar(*Term));
+    bool Negated = FlatAst::TermNegated(*Term);
+    if (Sum == nullptr) {
+      Sum = Negated ? Builder->CreateNeg(V) : V;
+    } else {
+      Sum = Negated ? Builder->CreateSub(Sum, V) : Builder->CreateAdd(Sum, V);
+    }
+  }
+
+  int Constant = Ast.ExprConstant[Expr];
+  Value *C = ConstantInt::get(Gen.GetContext(), APInt(32, Constant, true));
+  if (Sum == nullptr) {
+    return C;
+  }
+
+  return Constant != 0 ? Builder->CreateAdd(Sum, C) : Sum;
+}
+
+static void GenerateFlatStmts(GeneratorState &Gen, const FlatAst &Ast,
+                              uint32_t First, uint32_t Last);
+
+static void GenerateFlatBlock(GeneratorState &Gen, const FlatAst &Ast,
+                              uint32_t Block) {
+  GenerateFlatStmts(Gen, Ast, Ast.BlockFirst[Block], Ast.BlockFirst[Block + 1]);
+}
+
+// Тот же код, что у узлов дерева (см. выше), но обход идет по массивам.
+static void GenerateFlatStmts(GeneratorState &Gen, const FlatAst &Ast,
+                              uint32_t First, uint32_t Last) {
+  IRBuilder<> *Builder = Gen.GetBuilder();
+
+  for (uint32_t s = First; s < Last; ++s) {
+    switch (Ast.Kinds[s]) {
+    case FlatAst::FLAT_ASSIGN:
+      Gen.WriteVar(Ast.A[s], GenerateFlatExpr(Gen, Ast, Ast.Exprs[s]));
+      break;
+
+    case FlatAst::FLAT_INPUT:
+      Gen.WriteVar(Ast.A[s], Builder->CreateCall(Gen.BuiltinInput));
+      break;
+
+    case FlatAst::FLAT_PRINT:
+      Builder->CreateCall(Gen.BuiltinPrint,
+                          GenerateFlatExpr(Gen, Ast, Ast.Exprs[s]));
+      break;
+
+    case FlatAst::FLAT_IF: {
+      GeneratorState::IfState State;
+      Gen.BeginIf(Ast.Ops[s], GenerateFlatExpr(Gen, Ast, Ast.Exprs[s]), State);
+      GenerateFlatBlock(Gen, Ast, Ast.A[s]);
+      Gen.BeginElse(State);
+      GenerateFlatBlock(Gen, Ast, Ast.B[s]);
+      Gen.EndIf(State);
+      break;
+    }
+    }
+  }
+}
+
+Module *GenerateFlat(LLVMContext &Context, const FlatAst &Ast,
+                     const VariableTable &Vars, unsigned OptLevel,
+                     bool WithRuntime, unsigned ChunkSize, bool DirectSSA,
+                     const ProfileOptions &Profiling, CompileStats *Stats) {
+  GeneratorState Gen(Context);
+  Gen.DirectSSA = DirectSSA;
+  Gen.Profiling = Profiling;
+
+  uint32_t First = Ast.BlockFirst[FlatAst::ROOT_BLOCK];
+  uint32_t Count = Ast.BlockFirst[FlatAst::ROOT_BLOCK + 1] - First;
+
+  // Длинная программа делится на части, как и в Generate.
+  if (ChunkSize > 0 && Count > ChunkSize) {
+    PhaseTimer Timer(Stats, "codegen");
+    Gen.AddVariablesLazily(Vars);
+    Gen.CreateFrame(Vars.Size());
+    for (uint32_t Begin = 0; Begin < Count; Begin += ChunkSize) {
+      uint32_t End = std::min<uint32_t>(Count, Begin + ChunkSize);
+      Function *Chunk = Gen.CreateChunk(ChunkName(Begin / ChunkSize), false);
+      Gen.BeginChunk(Chunk);
+      GenerateFlatStmts(Gen, Ast, First + Begin, First + End);
+      Gen.EndChunk();
+      Gen.CallChunk(Chunk);
+    }
+
+    if (Stats != nullptr) {
+      Stats->SetCounter("chunks", (Count + ChunkSize - 1) / ChunkSize);
+    }
+  } else {
+    {
+      PhaseTimer Timer(Stats, "variables");
+      Gen.AddVariables(Vars);
+    }
+
+    PhaseTimer Timer(Stats, "codegen");
+    GenerateFlatStmts(Gen, Ast, First, First + Count);
+  }
+
+  return FinishModule(Gen, OptLevel, WithRuntime, Stats);
+}
@@ -1,38 +1,626 @@
+#include "arena.h"
 #include "ast.h"
+#include "bufferlexer.h"
+#include "bytecode.h"
+#include "cache.h"
+#include "flatast.h"
+#include "fold.h"
 #include "parser.h"
 #include "generator.h"
+#include "jit.h"
+#include "objemit.h"
+#include "parallelparse.h"
+#include "partition.h"
+#include "profile.h"
+#include "range.h"
+#include "source.h"
+#include "stats.h"
+#include "symbols.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
-#include <llvm/Support/raw_os_ostream.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 #include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/ToolOutputFile.h>
 
-Module *Generate(StmtNode *Prog);
+Module *Generate(LLVMContext &Context, StmtNode *Prog,
+                 const VariableTable &Vars, unsigned OptLevel,
+                 bool WithRuntime, unsigned ChunkSize, bool BatchEntry,
+                 bool DirectSSA, const ProfileOptions &Profiling,
+                 CompileStats *Stats);
+
+static void Usage() {
+  std::cerr << "Usage: toycompiler [options] [source]" << std::endl
+            << "  -o <file>     write output to file (default: stdout)"
+            << std::endl
+            << "  -c            emit a native object file instead of bitcode"
+            << std::endl
+            << "  -O<n>         optimization level, 0..3 (default: 3);"
+            << std::endl
+            << "                -O1 is the fixed fast function pipeline, "
+               "-O2/-O3 the full module pipeline" << std::endl
+            << "  --fast-lexer  map the source into memory and tokenize it "
+               "in one pass" << std::endl
+            << "  --no-fold     do not fold constants before code generation"
+            << std::endl
+            << "  --no-ranges   do not remove branches decided by value ranges"
+            << std::endl
+            << "  --no-runtime  do not link the runtime into the module; "
+               "link toystd.o" << std::endl
+            << "                with the program instead" << std::endl
+            << "  --parallel-parse  parse a large source in -j threads, "
+               "split at" << std::endl
+            << "                top-level statements" << std::endl
+            << "  --stream      generate code for each top-level statement "
+               "as soon as" << std::endl
+            << "                it is parsed, keeping front-end memory "
+               "bounded" << std::endl
+            << "  --chunk-size <n>  split programs longer than n top-level "
+               "statements" << std::endl
+            << "                into separate functions, compiled in "
+               "parallel with -c" << std::endl
+            << "                (default: 1000, 0 disables)" << std::endl
+            << "  --emit-ast    write the parsed program as a flat AST image; "
+               "a source" << std::endl
+            << "                starting with such an image is compiled "
+               "without parsing" << std::endl
+            << "  --ssa         build SSA form directly instead of one alloca "
+               "per variable" << std::endl
+            << "  --profile-generate <file>  count branch executions; the "
+               "program adds" << std::endl
+            << "                the counts to file at exit" << std::endl
+            << "  --profile-use <file>  weight branches by a profile from "
+               "--profile-generate" << std::endl
+            << "  --batch-entry also emit toy_batch() running the program "
+               "over many" << std::endl
+            << "                input sets at once (see toybatch.h)"
+            << std::endl
+            << "  --run         interpret the program instead of emitting "
+               "bitcode" << std::endl
+            << "  --jit         compile the program in memory and run it"
+            << std::endl
+            << "  --stats       report per-phase time and memory to stderr "
+               "as JSON" << std::endl
+            << "  --dump-ir     print the generated IR to stderr" << std::endl
+            << "  --batch <list>  compile every file named in list ('-' for "
+               "stdin), writing" << std::endl
+            << "                <name>.bc or <name>.o next to each source"
+            << std::endl
+            << "  -j<n>         number of worker threads for --batch, -c "
+               "and" << std::endl
+            << "                --parallel-parse (default: all cores)"
+            << std::endl
+            << "  --cache <dir>       reuse bitcode/objects from an on-disk "
+               "cache" << std::endl
+            << "  --cache-size <MiB>  cache size limit (default: 256)"
+            << std::endl;
+}
+
+// Параметры командной строки.
+struct DriverOptions {
+  const char *InputPath;
+  std::string OutputPath;
+  bool HasOutputPath;
+  unsigned OptLevel;
+  bool EmitObject;
+  bool FastLexer;
+  bool FoldConst;
+  bool PruneRanges;
+  bool LinkRuntime;
+  bool Stream;
+  bool ParallelParse;
+  bool Run;
+  bool Jit;
+  bool Stats;
+  bool DumpIR;
+  const char *BatchList;
+  unsigned Jobs;
+  unsigned ChunkSize;
+  bool BatchEntry;
+  bool EmitAst;
+  bool DirectSSA;
+  const char *ProfileUsePath;
+  ProfileOptions Profile;
+  const char *CacheDir;
+  unsigned CacheSizeMb;
+
+  DriverOptions()
+      : InputPath(nullptr), OutputPath("-"), HasOutputPath(false),
+        OptLevel(3), EmitObject(false), FastLexer(false), FoldConst(true),
+        PruneRanges(true), LinkRuntime(true), Stream(false),
+        ParallelParse(false), Run(false), Jit(false), Stats(false),
+        DumpIR(false), BatchList(nullptr), Jobs(0), ChunkSize(1000),
+        BatchEntry(false), EmitAst(false), DirectSSA(false),
+        ProfileUsePath(nullptr), CacheDir(nullptr), CacheSizeMb(256) {}
+};
+
+static bool ParseOptions(int argc, char **argv, DriverOptions &opts) {
+  for (int i = 1; i < argc; ++i) {
+    std::string Arg = argv[i];
+    if (Arg == "-o" && i + 1 < argc) {
+      opts.OutputPath = argv[++i];
+      opts.HasOutputPath = true;
+    } else if (Arg == "-c") {
+      opts.EmitObject = true;
+    } else if (Arg.size() == 3 && Arg[0] == '-' && Arg[1] == 'O' &&
+               Arg[2] >= '0' && Arg[2] <= '3') {
+      opts.OptLevel = Arg[2] - '0';
+    } else if (Arg == "--fast-lexer") {
+      opts.FastLexer = true;
+    } else if (Arg == "--no-fold") {
+      opts.FoldConst = false;
+    } else if (Arg == "--no-ranges") {
+      opts.PruneRanges = false;
+    } else if (Arg == "--no-runtime") {
+      opts.LinkRuntime = false;
+    } else if (Arg == "--parallel-parse") {
+      opts.ParallelParse = true;
+    } else if (Arg == "--stream") {
+      opts.Stream = true;
+    } else if (Arg == "--batch-entry") {
+      opts.BatchEntry = true;
+    } else if (Arg == "--emit-ast") {
+      opts.EmitAst = true;
+    } else if (Arg == "--ssa") {
+      opts.DirectSSA = true;
+    } else if (Arg == "--profile-generate" && i + 1 < argc) {
+      opts.Profile.GeneratePath = argv[++i];
+    } else if (Arg == "--profile-use" && i + 1 < argc) {
+      opts.ProfileUsePath = argv[++i];
+    } else if (Arg == "--run") {
+      opts.Run = true;
+    } else if (Arg == "--jit") {
+      opts.Jit = true;
+    } else if (Arg == "--stats") {
+      opts.Stats = true;
+    } else if (Arg == "--dump-ir") {
+      opts.DumpIR = true;
+    } else if (Arg == "--batch" && i + 1 < argc) {
+      opts.BatchList = argv[++i];
+    } else if (Arg.size() > 2 && Arg[0] == '-' && Arg[1] == 'j' &&
+               isdigit(Arg[2])) {
+      opts.Jobs = atoi(Arg.c_str() + 2);
+    } else if (Arg == "--chunk-size" && i + 1 < argc &&
+               isdigit(argv[i + 1][0])) {
+      opts.ChunkSize = atoi(argv[++i]);
+    } else if (Arg == "--cache" && i + 1 < argc) {
+      opts.CacheDir = argv[++i];
+    } else if (Arg == "--cache-size" && i + 1 < argc &&
+               isdigit(argv[i + 1][0])) {
+      opts.CacheSizeMb = atoi(argv[++i]);
+    } else if (Arg.size() > 1 && Arg[0] == '-') {
+      return false;
+    } else {
+      opts.InputPath = argv[i];
+    }
+  }
+
+  // В пакетном режиме программы не исполняются, результаты пишутся
+  // рядом с исходными файлами, а статистика собирается только для
+  // одной компиляции.
+  if (opts.BatchList != nullptr &&
+      (opts.Run || opts.Jit || opts.HasOutputPath || opts.Stats)) {
+    return false;
+  }
+
+  // Интерпретатору байт-кода, пакетной точке входа и параллельному
+  // разбору нужна вся программа целиком.
+  if (opts.Stream && (opts.Run || opts.BatchEntry || opts.ParallelParse)) {
+    return false;
+  }
+
+  // Плоское представление записывается вместо кода, а не вместе с ним.
+  if (opts.EmitAst &&
+      (opts.Run || opts.Jit || opts.Stream || opts.BatchEntry)) {
+    return false;
+  }
+
+  // Профиль пишет только самостоятельная программа, и он относится
+  // к одной программе, а не к пакету.
+  bool Profiled = !opts.Profile.GeneratePath.empty();
+  if (Profiled && (opts.Run || opts.Jit || opts.EmitAst)) {
+    return false;
+  }
+  if ((Profiled || opts.ProfileUsePath != nullptr) &&
+      opts.BatchList != nullptr) {
+    return false;
+  }
+
+  return true;
+}
+
+// Запись биткода в файл или в stdout.
+static bool WriteBitcode(Module *module, const std::string &path,
+                         std::string &error) {
+  tool_output_file Out(path.c_str(), error, sys::fs::F_Binary);
+  if (!error.empty()) {
+    return false;
+  }
+
+  WriteBitcodeToFile(module, Out.os());
+  Out.keep();
+  return true;
+}
+
+// Запись образа плоского представления в файл или в stdout.
+static bool WriteImage(const std::string &image, const std::string &path,
+                       std::string &error) {
+  tool_output_file Out(path.c_str(), error, sys::fs::F_Binary);
+  if (!error.empty()) {
+    return false;
+  }
+
+  Out.os().write(image.data(), image.size());
+  Out.keep();
+  return true;
+}
+
+// Исполнение модуля JIT-компилятором или запись результата компиляции.
+static int EmitModule(const DriverOptions &Opts, Module *Main,
+                      CompileStats *Stats) {
+  if (Opts.Jit) {
+    PhaseTimer Timer(Stats, "jit");
+    return RunJIT(Main) ? 0 : -1;
+  }
+
+  // Модуль удаляется раньше своего контекста.
+  std::unique_ptr<Module> Owner(Main);
+
+  if (Opts.DumpIR) {
+    Main->dump();
+  }
+
+  // Объектный файл или биткод LLVM IR (по умолчанию в stdout).
+  PhaseTimer Timer(Stats, "emit");
+  std::string Error;
+  bool Written =
+      Opts.EmitObject
+          ? EmitObjectFile(Main, Opts.OutputPath, Opts.OptLevel, Error)
+          : WriteBitcode(Main, Opts.OutputPath, Error);
+  if (!Written) {
+    std::cerr << Error << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+// Потоковая компиляция: каждый оператор верхнего уровня сразу после
+// разбора сворачивается и переводится в IR, а его дерево освобождается.
+// Память фронтенда не растет с длиной программы; переменные создаются
+// в начале функции при первом обращении. Если задан размер части,
+// каждые ChunkSize операторов образуют отдельную функцию.
+static int CompileStreaming(const DriverOptions &Opts, TokenSource &Lex,
+                            Arena &Nodes, VariableTable &Vars,
+                            LLVMContext &Context, CompileStats *Stats) {
+  GeneratorState Gen(Context);
+  Gen.DirectSSA = Opts.DirectSSA;
+  Gen.Profiling = Opts.Profile;
+  Gen.AddVariablesLazily(Vars);
+
+  // Размер кадра станет известен только в конце программы.
+  const unsigned ChunkSize = Opts.ChunkSize;
+  Function *Chunk = nullptr;
+  if (ChunkSize > 0) {
+    Gen.CreateFrame(0);
+  }
+
+  // Известные значения переменных переходят от оператора к оператору.
+  FoldState Fold(Nodes, 0);
+  RangeState Ranges(Nodes, 0);
+  size_t Statements = 0;
+  size_t PeakArenaBytes = 0;
+
+  {
+    PhaseTimer Timer(Stats, "stream");
+    Parser P(Lex, Nodes, Vars);
+    while (StmtNode *Stmt = P.ParseNext()) {
+      if (!P.ParserSuccess()) {
+        std::cerr << "Incorrent program." << std::endl << std::endl;
+        Stmt->Format(std::cerr, 0);
+        std::cerr << std::endl;
+        delete Gen.GetMainModule();
+        return 1;
+      }
+
+      if (Opts.FoldConst) {
+        Fold.AddVariables(Vars.Size());
+        Stmt = FoldConstants(Stmt, Fold);
+      }
+
+      if (Opts.PruneRanges) {
+        Ranges.AddVariables(Vars.Size());
+        Stmt = PruneBranches(Stmt, Ranges);
+      }
+
+      if (ChunkSize > 0 && Statements % ChunkSize == 0) {
+        Chunk = Gen.CreateChunk(ChunkName(Statements / ChunkSize), false);
+        Gen.BeginChunk(Chunk);
+      }
+
+      Stmt->Generate(&Gen);
+
+      ++Statements;
+      PeakArenaBytes = std::max(PeakArenaBytes, Nodes.GetBytesReserved());
+      Nodes.Reset();
+
+      if (Chunk != nullptr && Statements % ChunkSize == 0) {
+        Gen.EndChunk();
+        Gen.CallChunk(Chunk);
+        Chunk = nullptr;
+      }
+    }
+  }
+
+  if (Chunk != nullptr) {
+    Gen.EndChunk();
+    Gen.CallChunk(Chunk);
+  }
+
+  if (ChunkSize > 0) {
+    Gen.SetFrameSize(Vars.Size());
+  }
+
+  if (Stats != nullptr) {
+    Stats->SetCounter("statements", Statements);
+    Stats->SetCounter("ast_arena_peak_bytes", PeakArenaBytes);
+    Stats->SetCounter("variables", Vars.Size());
+    if (Opts.FoldConst) {
+      Stats->SetCounter("folded_exprs", Fold.FoldedExprs);
+      Stats->SetCounter("removed_branches", Fold.RemovedBranches);
+    }
+    if (Opts.PruneRanges) {
+      Stats->SetCounter("pruned_branches", Ranges.RemovedBranches);
+    }
+  }
+
+  Module *Main = FinishModule(Gen, Opts.OptLevel,
+                              Opts.LinkRuntime && !Opts.Jit, Stats);
+  if (Main == nullptr) {
+    return -1;
+  }
+
+  return EmitModule(Opts, Main, Stats);
+}
+
+// Компиляция уже разобранной программы из образа плоского
+// представления: лексер, разбор и свертка пропускаются.
+static int CompileFlat(const DriverOptions &Opts, const SourceBuffer &Image,
+                       LLVMContext &Context, CompileStats *Stats) {
+  if (Opts.Run || Opts.Stream || Opts.BatchEntry || Opts.ParallelParse ||
+      Opts.EmitAst) {
+    std::cerr << "This mode is not supported for a flat AST input"
+              << std::endl;
+    return -1;
+  }
+
+  FlatAst Ast;
+  VariableTable Vars;
+  {
+    PhaseTimer Timer(Stats, "load_ast");
+    std::string Error;
+    if (!Ast.Load(Image.Begin(), Image.End(), Error)) {
+      std::cerr << Error << std::endl;
+      return -1;
+    }
+
+    Ast.GetVariables(Vars);
+  }
+
+  if (Stats != nullptr) {
+    Stats->SetCounter("flat_ast_bytes", Image.Size());
+    Stats->SetCounter("statements", Ast.NumStmts);
+    Stats->SetCounter("variables", Vars.Size());
+  }
+
+  Module *Main = GenerateFlat(Context, Ast, Vars, Opts.OptLevel,
+                              Opts.LinkRuntime && !Opts.Jit, Opts.ChunkSize,
+                              Opts.DirectSSA, Opts.Profile, Stats);
+  if (Main == nullptr) {
+    return -1;
+  }
+
+  return EmitModule(Opts, Main, Stats);
+}
+
+// Компиляция программы; возвращает код завершения.
+// Если текст программы уже загружен (preloaded), он разбирается
+// из памяти, иначе читается из InputPath или stdin.
+static int Compile(const DriverOptions &Opts, CompileStats *Stats,
+                   const SourceBuffer *Preloaded = nullptr) {
+  const char *InputPath = Opts.InputPath;
+
+  // Арена владеет всем деревом программы и освобождает его разом.
+  // Контекст LLVM тоже свой у каждой компиляции.
+  Arena Nodes;
+  VariableTable Vars;
+  LLVMContext Context;
 
-int main(int argc, char **argv) {
   std::ifstream input;
-  Parser *P;
+  SourceBuffer Source;
+  std::unique_ptr<TokenSource> Lex;
+
+  // Потоковый лексер читает уже открытый поток.
+  std::istream *Stream = nullptr;
+  if (Preloaded == nullptr && !Opts.FastLexer && !Opts.ParallelParse) {
+    if (InputPath != nullptr) {
+      input.open(InputPath, std::ifstream::in);
+      if (!input.is_open())
+        return -1;
+
+      Stream = &input;
+    } else {
+      Stream = &std::cin;
+    }
+  }
 
-  if (argc > 1) {
-    input.open(argv[1], std::ifstream::in);
-    if (!input.is_open())
+  // Разбору из памяти нужен весь текст программы, а образ плоского
+  // представления отображается в память целиком. Поток загружается,
+  // только если его первый символ совпадает с началом сигнатуры;
+  // сама сигнатура проверяется по загруженному тексту.
+  if (Preloaded == nullptr &&
+      (Stream == nullptr || FlatAst::MayBeFlatAst(Stream->peek()))) {
+    PhaseTimer Timer(Stats, "load");
+    std::string Error;
+    bool Loaded = InputPath != nullptr ? Source.Open(InputPath, Error)
+                  : Stream != nullptr  ? Source.Read(*Stream, Error)
+                                       : Source.Read(0, Error);
+    if (!Loaded) {
+      std::cerr << Error << std::endl;
       return -1;
+    }
 
-    P = new Parser(input);
+    Preloaded = &Source;
+  }
+
+  if (Preloaded != nullptr &&
+      FlatAst::IsFlatAst(Preloaded->Begin(), Preloaded->End())) {
+    return CompileFlat(Opts, *Preloaded, Context, Stats);
+  }
+
+  StmtNode *Prog;
+  bool Success;
+
+  if (Opts.ParallelParse) {
+    PhaseTimer Timer(Stats, "parse");
+    unsigned Jobs = Opts.Jobs != 0
+                        ? Opts.Jobs
+                        : std::max(1u, std::thread::hardware_concurrency());
+    size_t Chunks;
+    Prog = ParseParallel(Preloaded->Begin(), Preloaded->End(), Nodes, Vars,
+                         Jobs, Success, Chunks);
+    if (Stats != nullptr) {
+      Stats->SetCounter("source_bytes", Preloaded->Size());
+      Stats->SetCounter("parse_chunks", Chunks);
+    }
   } else {
-    P = new Parser(std::cin);
-  }
-
-  auto Prog = P->Parse();
-  if (P->ParserSuccess()) {
-    Module *Main = Generate(Prog);
-    if (Main != nullptr) {
-      Main->dump();
-      
-      // Сохранение биткода LLVM IR в stdout
-      llvm::raw_os_ostream os(std::cout);
-      llvm::WriteBitcodeToFile(Main, os);
+    if (Preloaded != nullptr) {
+      PhaseTimer Timer(Stats, "lex");
+      BufferLexer *Buffered =
+          new BufferLexer(Preloaded->Begin(), Preloaded->End(), Vars);
+      Lex.reset(Buffered);
+      Buffered->Tokenize();
+      if (Stats != nullptr) {
+        Stats->SetCounter("source_bytes", Preloaded->Size());
+        Stats->SetCounter("tokens", Buffered->GetTokens().size());
+      }
+    } else {
+      Lex.reset(new Lexer(*Stream, Vars));
+    }
+
+    if (Opts.Stream) {
+      return CompileStreaming(Opts, *Lex, Nodes, Vars, Context, Stats);
+    }
+
+    PhaseTimer Timer(Stats, "parse");
+    Parser P(*Lex, Nodes, Vars);
+    Prog = P.Parse();
+    Success = P.ParserSuccess();
+  }
+
+  if (Stats != nullptr) {
+    Stats->SetCounter("ast_nodes", Nodes.GetObjectCount());
+    Stats->SetCounter("ast_arena_bytes", Nodes.GetBytesReserved());
+    Stats->SetCounter("variables", Vars.Size());
+  }
+
+  if (Success) {
+    if (Opts.FoldConst) {
+      PhaseTimer Timer(Stats, "fold");
+      FoldState State(Nodes, Vars.Size());
+      Prog = FoldConstants(Prog, State);
+      if (Stats != nullptr) {
+        Stats->SetCounter("folded_exprs", State.FoldedExprs);
+        Stats->SetCounter("removed_branches", State.RemovedBranches);
+      }
+    }
+
+    if (Opts.PruneRanges) {
+      PhaseTimer Timer(Stats, "ranges");
+      RangeState State(Nodes, Vars.Size());
+      Prog = PruneBranches(Prog, State);
+      if (Stats != nullptr) {
+        Stats->SetCounter("pruned_branches", State.RemovedBranches);
+      }
+    }
+
+    if (Opts.EmitAst) {
+      PhaseTimer Timer(Stats, "emit_ast");
+      std::string Image, Error;
+      if (!FlattenProgram(Prog, Vars, Image)) {
+        std::cerr << "Program is nested too deeply for a flat AST image"
+                  << std::endl;
+        return -1;
+      }
+
+      if (Stats != nullptr) {
+        Stats->SetCounter("flat_ast_bytes", Image.size());
+      }
+
+      if (!WriteImage(Image, Opts.OutputPath, Error)) {
+        std::cerr << Error << std::endl;
+        return -1;
+      }
+
+      return 0;
+    }
+
+    if (Opts.Run) {
+      BytecodeProgram Code;
+      {
+        PhaseTimer Timer(Stats, "lower");
+        LowerProgram(Prog, Vars.Size(), Code);
+      }
+
+      PhaseTimer Timer(Stats, "run");
+      RunBytecode(Code);
+      return 0;
+    }
+
+    // Длинная программа компилируется в объектный файл по частям
+    // в нескольких потоках. Условные операторы нумеруются для профиля
+    // по всей программе, поэтому с профилем она собирается целиком.
+    SeqNode *Seq = dynamic_cast<SeqNode *>(Prog);
+    unsigned Jobs = Opts.Jobs != 0
+                        ? Opts.Jobs
+                        : std::max(1u, std::thread::hardware_concurrency());
+    if (Opts.EmitObject && !Opts.DumpIR && !Opts.BatchEntry &&
+        !Opts.Profile.Enabled() && Opts.OutputPath != "-" &&
+        Opts.ChunkSize > 0 && Jobs > 1 && Seq != nullptr &&
+        Seq->GetStatements().size() > Opts.ChunkSize) {
+      PhaseTimer Timer(Stats, "partitions");
+      std::string Error;
+      if (!EmitPartitioned(Seq->GetStatements(), Vars, Opts.OptLevel,
+                           Opts.LinkRuntime, Opts.DirectSSA, Opts.ChunkSize,
+                           Jobs, Opts.OutputPath, Error)) {
+        std::cerr << Error << std::endl;
+        return -1;
+      }
+
       return 0;
     }
+
+    // Под JIT встроенные функции берутся из самого компилятора.
+    Module *Main = Generate(Context, Prog, Vars, Opts.OptLevel,
+                            Opts.LinkRuntime && !Opts.Jit, Opts.ChunkSize,
+                            Opts.BatchEntry, Opts.DirectSSA, Opts.Profile,
+                            Stats);
+    if (Main == nullptr) {
+      return -1;
+    }
+
+    return EmitModule(Opts, Main, Stats);
   }
 
   std::cerr << "Incorrent program." << std::endl << std::endl;
@@ -41,5 +629,226 @@ int main(int argc, char **argv) {
     std::cerr << std::endl;
   }
 
+  return 1;
+}
+
+// Параметры, от которых зависит результат компиляции (часть ключа кэша).
+static std::string CacheConfig(const DriverOptions &Opts) {
+  std::string Config = "-O" + std::to_string(Opts.OptLevel);
+  Config += Opts.EmitObject ? " obj" : " bc";
+  Config += Opts.FoldConst ? " fold" : " nofold";
+  Config += Opts.PruneRanges ? " ranges" : "";
+  Config += Opts.LinkRuntime ? " runtime" : " noruntime";
+  Config += Opts.Stream ? " stream" : "";
+  Config += " chunk" + std::to_string(Opts.ChunkSize);
+  Config += Opts.BatchEntry ? " batchentry" : "";
+  Config += Opts.EmitAst ? " ast" : "";
+  Config += Opts.DirectSSA ? " ssa" : "";
+  return Config;
+}
+
+// Компиляция через кэш: при попадании разбор, генерация кода
+// и оптимизация пропускаются, а готовый результат копируется из кэша.
+static int CompileCached(const DriverOptions &Opts, CompileStats *Stats,
+                         CompileCache &Cache) {
+  SourceBuffer Source;
+  std::string Key;
+  bool Flat;
+  {
+    PhaseTimer Timer(Stats, "cache_lookup");
+    std::string Error;
+    bool Loaded = Opts.InputPath != nullptr
+                      ? Source.Open(Opts.InputPath, Error)
+                      : Source.Read(0, Error);
+    if (!Loaded) {
+      std::cerr << Error << std::endl;
+      return -1;
+    }
+
+    // Ключ строится по нормализованному тексту, а в двоичном образе
+    // пробельные байты значимы, поэтому образы не кэшируются.
+    Flat = FlatAst::IsFlatAst(Source.Begin(), Source.End());
+    if (!Flat) {
+      Key = CompileCache::MakeKey(Source.Begin(), Source.End(),
+                                  CacheConfig(Opts));
+      bool Hit = Cache.Lookup(Key, Opts.OutputPath);
+      if (Stats != nullptr) {
+        Stats->SetCounter("cache_hit", Hit);
+      }
+
+      if (Hit) {
+        return 0;
+      }
+    }
+  }
+
+  if (Flat) {
+    return Compile(Opts, Stats, &Source);
+  }
+
+  DriverOptions TempOpts = Opts;
+  TempOpts.OutputPath = Cache.TempPath();
+  int Status = Compile(TempOpts, Stats, &Source);
+  if (Status != 0) {
+    unlink(TempOpts.OutputPath.c_str());
+    return Status;
+  }
+
+  PhaseTimer Timer(Stats, "cache_store");
+  if (!Cache.Store(Key, TempOpts.OutputPath, Opts.OutputPath)) {
+    std::cerr << "cannot store compilation result in cache" << std::endl;
+    return -1;
+  }
+
   return 0;
 }
+
+// Компиляция одного файла, через кэш, если он задан.
+static int CompileFile(const DriverOptions &Opts, CompileStats *Stats,
+                       CompileCache *Cache) {
+  // Исполняемые сразу программы ничего не сохраняют, кэшировать нечего.
+  // Результат с профилем зависит от файла профиля, который не входит
+  // в ключ кэша.
+  if (Cache == nullptr || Opts.Run || Opts.Jit || Opts.Profile.Enabled()) {
+    return Compile(Opts, Stats);
+  }
+
+  return CompileCached(Opts, Stats, *Cache);
+}
+
+// Имя выходного файла для пакетного режима: program.toy -> program.o
+static std::string BatchOutputPath(const std::string &input,
+                                   const DriverOptions &opts) {
+  std::string Base = input;
+  size_t Dot = Base.rfind('.');
+  size_t Slash = Base.rfind('/');
+  if (Dot != std::string::npos && (Slash == std::string::npos || Dot > Slash)) {
+    Base.erase(Dot);
+  }
+
+  if (opts.EmitAst) {
+    return Base + ".tast";
+  }
+
+  return Base + (opts.EmitObject ? ".o" : ".bc");
+}
+
+// Пакетная компиляция: файлы из списка раздаются рабочим потокам,
+// каждая компиляция полностью независима от остальных.
+static int CompileBatch(const DriverOptions &Opts, CompileCache *Cache) {
+  std::vector<std::string> Inputs;
+  std::ifstream ListFile;
+  std::istream *List = &std::cin;
+  if (std::string(Opts.BatchList) != "-") {
+    ListFile.open(Opts.BatchList, std::ifstream::in);
+    if (!ListFile.is_open()) {
+      std::cerr << Opts.BatchList << ": cannot open file list" << std::endl;
+      return -1;
+    }
+
+    List = &ListFile;
+  }
+
+  std::string Line;
+  while (std::getline(*List, Line)) {
+    if (!Line.empty()) {
+      Inputs.push_back(Line);
+    }
+  }
+
+  unsigned Threads = Opts.Jobs;
+  if (Threads == 0) {
+    Threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  Threads = std::min<size_t>(Threads, std::max<size_t>(Inputs.size(), 1));
+
+  llvm_start_multithreaded();
+
+  std::atomic<size_t> Next(0);
+  std::atomic<unsigned> Failed(0);
+  std::mutex ErrorLock;
+
+  auto Worker = [&]() {
+    size_t i;
+    while ((i = Next.fetch_add(1)) < Inputs.size()) {
+      DriverOptions FileOpts = Opts;
+      FileOpts.InputPath = Inputs[i].c_str();
+      FileOpts.OutputPath = BatchOutputPath(Inputs[i], Opts);
+      // Потоки уже заняты файлами, сами файлы компилируются в одном.
+      FileOpts.Jobs = 1;
+      if (CompileFile(FileOpts, nullptr, Cache) != 0) {
+        ++Failed;
+        std::lock_guard<std::mutex> Guard(ErrorLock);
+        std::cerr << Inputs[i] << ": compilation failed" << std::endl;
+      }
+    }
+  };
+
+  std::vector<std::thread> Pool;
+  for (unsigned t = 0; t < Threads; ++t) {
+    Pool.push_back(std::thread(Worker));
+  }
+
+  for (auto &thread : Pool) {
+    thread.join();
+  }
+
+  if (Cache != nullptr) {
+    std::cerr << "cache: " << Cache->GetHits() << " hits, "
+              << Cache->GetMisses() << " misses" << std::endl;
+  }
+
+  return Failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  DriverOptions Opts;
+  if (!ParseOptions(argc, argv, Opts)) {
+    Usage();
+    return -1;
+  }
+
+  BranchProfile Profile;
+  if (Opts.ProfileUsePath != nullptr) {
+    std::string Error;
+    if (!Profile.Load(Opts.ProfileUsePath, Error)) {
+      std::cerr << Error << std::endl;
+      return -1;
+    }
+
+    Opts.Profile.Use = &Profile;
+  }
+
+  std::unique_ptr<CompileCache> Cache;
+  if (Opts.CacheDir != nullptr) {
+    std::string Error;
+    Cache.reset(new CompileCache(Opts.CacheDir,
+                                 (uint64_t)Opts.CacheSizeMb << 20));
+    if (!Cache->Init(Error)) {
+      std::cerr << Error << std::endl;
+      return -1;
+    }
+  }
+
+  int Status;
+  if (Opts.BatchList != nullptr) {
+    Status = CompileBatch(Opts, Cache.get());
+  } else {
+    CompileStats Stats;
+    if (Opts.Stats) {
+      CompileStats::EnableAllocationCounting();
+    }
+    Status = CompileFile(Opts, Opts.Stats ? &Stats : nullptr, Cache.get());
+
+    if (Opts.Stats) {
+      Stats.WriteJSON(std::cerr);
+    }
+  }
+
+  // Вытеснение лишних записей - один раз за запуск.
+  if (Cache != nullptr) {
+    Cache->Trim();
+  }
+
+  return Status;
+}
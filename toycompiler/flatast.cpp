@@ -0,0 +1,391 @@
+#include "flatast.h"
+#include "ast.h"
+#include "symbols.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+// Формат образа
+// =====================================================================
+
+namespace {
+
+const char FLAT_MAGIC[8] = {'T', 'O', 'Y', 'F', 'L', 'A', 'T', '\0'};
+const uint32_t FLAT_VERSION = 2;
+
+// Записывается в порядке байтов машины, создавшей образ.
+const uint32_t FLAT_BYTE_ORDER = 0x01020304;
+
+struct FlatHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t ByteOrder;
+  uint32_t NumStmts, NumBlocks, NumExprs, NumTerms, NumVars, NameBytes;
+};
+
+// Размеры столбцов в порядке их следования за заголовком: сначала
+// 32-битные, затем байтовые, поэтому выравнивание сохраняется.
+struct FlatLayout {
+  size_t Words, Bytes;
+
+  FlatLayout(const FlatHeader &h) {
+    Words = 3 * (size_t)h.NumStmts + (size_t)h.NumBlocks + 1 +
+            2 * (size_t)h.NumExprs + 1 + h.NumTerms + (size_t)h.NumVars + 1;
+    Bytes = 2 * (size_t)h.NumStmts + h.NameBytes;
+  }
+
+  size_t Total() const { return sizeof(FlatHeader) + 4 * Words + Bytes; }
+};
+
+template <typename T>
+void Append(std::string &image, const std::vector<T> &column) {
+  image.append(reinterpret_cast<const char *>(column.data()),
+               column.size() * sizeof(T));
+}
+
+// Смещения offsets[0..count] начинаются с нуля, не убывают
+// и заканчиваются на total.
+bool CheckOffsets(const uint32_t *offsets, uint32_t count, uint32_t total) {
+  if (offsets[0] != 0 || offsets[count] != total) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < count; ++i) {
+    if (offsets[i] > offsets[i + 1]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+template <typename T> const T *Take(const char *&pos, size_t count) {
+  const T *Column = reinterpret_cast<const T *>(pos);
+  pos += count * sizeof(T);
+  return Column;
+}
+
+} // namespace
+
+// Загрузка
+// =====================================================================
+
+FlatAst::FlatAst()
+    : NumStmts(0), NumBlocks(0), NumExprs(0), NumTerms(0), NumVars(0),
+      Kinds(nullptr), Ops(nullptr), A(nullptr), B(nullptr), Exprs(nullptr),
+      BlockFirst(nullptr), ExprConstant(nullptr), ExprFirst(nullptr),
+      Terms(nullptr), NameOffsets(nullptr), Names(nullptr) {}
+
+bool FlatAst::IsFlatAst(const char *begin, const char *end) {
+  return (size_t)(end - begin) >= sizeof(FLAT_MAGIC) &&
+         memcmp(begin, FLAT_MAGIC, sizeof(FLAT_MAGIC)) == 0;
+}
+
+bool FlatAst::MayBeFlatAst(int firstChar) {
+  return firstChar == FLAT_MAGIC[0];
+}
+
+bool FlatAst::Load(const char *begin, const char *end, std::string &error) {
+  FlatHeader Header;
+  size_t Size = end - begin;
+  if (Size < sizeof(Header) || !IsFlatAst(begin, end)) {
+    error = "not a flat AST image";
+    return false;
+  }
+
+  memcpy(&Header, begin, sizeof(Header));
+  if (Header.Version != FLAT_VERSION || Header.ByteOrder != FLAT_BYTE_ORDER) {
+    error = "unsupported flat AST version or byte order";
+    return false;
+  }
+
+  if (FlatLayout(Header).Total() != Size || Header.NumBlocks == 0 ||
+      reinterpret_cast<uintptr_t>(begin) % 4 != 0) {
+    error = "corrupted flat AST image";
+    return false;
+  }
+
+  NumStmts = Header.NumStmts;
+  NumBlocks = Header.NumBlocks;
+  NumExprs = Header.NumExprs;
+  NumTerms = Header.NumTerms;
+  NumVars = Header.NumVars;
+
+  const char *Pos = begin + sizeof(Header);
+  A = Take<uint32_t>(Pos, NumStmts);
+  B = Take<uint32_t>(Pos, NumStmts);
+  Exprs = Take<uint32_t>(Pos, NumStmts);
+  BlockFirst = Take<uint32_t>(Pos, NumBlocks + 1);
+  ExprConstant = Take<int32_t>(Pos, NumExprs);
+  ExprFirst = Take<uint32_t>(Pos, NumExprs + 1);
+  Terms = Take<uint32_t>(Pos, NumTerms);
+  NameOffsets = Take<uint32_t>(Pos, NumVars + 1);
+  Kinds = Take<uint8_t>(Pos, NumStmts);
+  Ops = Take<uint8_t>(Pos, NumStmts);
+  Names = Pos;
+
+  // Проверка ссылок. Смещения не убывают и покрывают столбцы целиком,
+  // поэтому каждый оператор принадлежит ровно одному блоку.
+  error = "corrupted flat AST image";
+  if (!CheckOffsets(BlockFirst, NumBlocks, NumStmts) ||
+      !CheckOffsets(ExprFirst, NumExprs, NumTerms)) {
+    return false;
+  }
+
+  for (uint32_t t = 0; t < NumTerms; ++t) {
+    if (TermVar(Terms[t]) >= NumVars) {
+      return false;
+    }
+  }
+
+  if (!CheckOffsets(NameOffsets, NumVars, Header.NameBytes)) {
+    return false;
+  }
+
+  // Номер переменной определяется ее именем, поэтому имена разные:
+  // иначе таблица из GetVariables окажется короче NumVars.
+  std::unordered_set<std::string> Seen;
+  for (uint32_t v = 0; v < NumVars; ++v) {
+    if (!Seen.insert(std::string(Names + NameOffsets[v],
+                                 NameOffsets[v + 1] - NameOffsets[v]))
+             .second) {
+      return false;
+    }
+  }
+
+  for (uint32_t s = 0; s < NumStmts; ++s) {
+    switch (Kinds[s]) {
+    case FLAT_ASSIGN:
+    case FLAT_INPUT:
+      if (A[s] >= NumVars ||
+          (Kinds[s] == FLAT_ASSIGN && Exprs[s] >= NumExprs)) {
+        return false;
+      }
+      break;
+    case FLAT_PRINT:
+      if (Exprs[s] >= NumExprs) {
+        return false;
+      }
+      break;
+    case FLAT_IF:
+      if (Ops[s] > POSITIVE || Exprs[s] >= NumExprs || A[s] >= NumBlocks ||
+          B[s] >= NumBlocks) {
+        return false;
+      }
+      break;
+    default:
+      return false;
+    }
+  }
+
+  // На каждый блок, кроме корня, ссылается ровно один условный
+  // оператор, и номера идут в порядке прямого обхода.
+  uint32_t NextBlock = ROOT_BLOCK;
+  if (!CheckBlock(ROOT_BLOCK, 0, NextBlock) || NextBlock != NumBlocks) {
+    return false;
+  }
+
+  error.clear();
+  return true;
+}
+
+bool FlatAst::CheckBlock(uint32_t block, unsigned depth,
+                         uint32_t &nextBlock) const {
+  if (block != nextBlock || depth > MAX_DEPTH) {
+    return false;
+  }
+
+  ++nextBlock;
+  for (uint32_t s = BlockFirst[block]; s < BlockFirst[block + 1]; ++s) {
+    if (Kinds[s] == FLAT_IF && (!CheckBlock(A[s], depth + 1, nextBlock) ||
+                                !CheckBlock(B[s], depth + 1, nextBlock))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void FlatAst::GetVariables(VariableTable &vars) const {
+  for (uint32_t v = 0; v < NumVars; ++v) {
+    vars.Intern(std::string(Names + NameOffsets[v],
+                            NameOffsets[v + 1] - NameOffsets[v]));
+  }
+}
+
+// Построение
+// =====================================================================
+
+// Операторы последовательности с раскрытием вложенных
+// последовательностей (они появляются после свертки констант).
+static void CollectStatements(StmtNode *stmt, std::vector<StmtNode *> &out) {
+  if (stmt == nullptr) {
+    return;
+  }
+
+  SeqNode *Seq = dynamic_cast<SeqNode *>(stmt);
+  if (Seq == nullptr) {
+    out.push_back(stmt);
+    return;
+  }
+
+  for (auto child : Seq->GetStatements()) {
+    CollectStatements(child, out);
+  }
+}
+
+uint32_t FlatAstBuilder::AddBlock(StmtNode *stmt) {
+  MaxDepth = std::max(MaxDepth, Depth);
+  size_t Mark = Pending.size();
+  CollectStatements(stmt, Pending);
+
+  // Места для всех операторов блока выделяются сразу, чтобы они легли
+  // подряд; вложенные блоки займут места после них.
+  uint32_t Block = BlockFirst.size() - 1;
+  uint32_t First = Kinds.size();
+  uint32_t Count = Pending.size() - Mark;
+  BlockFirst.push_back(First + Count);
+
+  Kinds.resize(First + Count, FlatAst::FLAT_PRINT);
+  Ops.resize(First + Count, 0);
+  A.resize(First + Count, 0);
+  B.resize(First + Count, 0);
+  Exprs.resize(First + Count, 0);
+
+  // Заполнение мест может снова вызвать AddBlock, который дополнит
+  // Pending, поэтому операторы читаются по номеру, а не итератором.
+  ++Depth;
+  for (uint32_t i = 0; i < Count; ++i) {
+    Pending[Mark + i]->Flatten(*this, First + i);
+  }
+  --Depth;
+
+  Pending.resize(Mark);
+  return Block;
+}
+
+uint32_t FlatAstBuilder::AddExpr(ExprNode *expr) {
+  uint32_t Expr = ExprConstant.size();
+
+  Constant = 0;
+  expr->Flatten(*this, false);
+
+  ExprConstant.push_back((int)Constant);
+  ExprFirst.push_back(Terms.size());
+  return Expr;
+}
+
+void FlatAstBuilder::SetAssign(uint32_t slot, unsigned id, uint32_t expr) {
+  Kinds[slot] = FlatAst::FLAT_ASSIGN;
+  A[slot] = id;
+  Exprs[slot] = expr;
+}
+
+void FlatAstBuilder::SetIf(uint32_t slot, unsigned op, uint32_t cond,
+                           uint32_t thenBlock, uint32_t elseBlock) {
+  Kinds[slot] = FlatAst::FLAT_IF;
+  Ops[slot] = op;
+  Exprs[slot] = cond;
+  A[slot] = thenBlock;
+  B[slot] = elseBlock;
+}
+
+void FlatAstBuilder::SetPrint(uint32_t slot, uint32_t expr) {
+  Kinds[slot] = FlatAst::FLAT_PRINT;
+  Exprs[slot] = expr;
+}
+
+void FlatAstBuilder::SetInput(uint32_t slot, unsigned id) {
+  Kinds[slot] = FlatAst::FLAT_INPUT;
+  A[slot] = id;
+}
+
+void FlatAstBuilder::Write(const VariableTable &vars,
+                           std::string &image) const {
+  std::vector<uint32_t> NameOffsets(1, 0);
+  std::string Names;
+  for (unsigned v = 0; v < vars.Size(); ++v) {
+    Names += vars.GetName(v);
+    NameOffsets.push_back(Names.size());
+  }
+
+  FlatHeader Header;
+  memcpy(Header.Magic, FLAT_MAGIC, sizeof(FLAT_MAGIC));
+  Header.Version = FLAT_VERSION;
+  Header.ByteOrder = FLAT_BYTE_ORDER;
+  Header.NumStmts = Kinds.size();
+  Header.NumBlocks = BlockFirst.size() - 1;
+  Header.NumExprs = ExprConstant.size();
+  Header.NumTerms = Terms.size();
+  Header.NumVars = vars.Size();
+  Header.NameBytes = Names.size();
+
+  image.clear();
+  image.reserve(FlatLayout(Header).Total());
+  image.append(reinterpret_cast<const char *>(&Header), sizeof(Header));
+  Append(image, A);
+  Append(image, B);
+  Append(image, Exprs);
+  Append(image, BlockFirst);
+  Append(image, ExprConstant);
+  Append(image, ExprFirst);
+  Append(image, Terms);
+  Append(image, NameOffsets);
+  Append(image, Kinds);
+  Append(image, Ops);
+  image += Names;
+}
+
+bool FlattenProgram(StmtNode *prog, const VariableTable &vars,
+                    std::string &image) {
+  FlatAstBuilder Builder;
+  Builder.AddBlock(prog);
+  if (Builder.GetMaxDepth() > FlatAst::MAX_DEPTH) {
+    return false;
+  }
+
+  Builder.Write(vars, image);
+  return true;
+}
+
+// Построение для узлов дерева
+// =====================================================================
+
+void ConstNode::Flatten(FlatAstBuilder &builder, bool negate) {
+  builder.AddConstant(negate ? -(unsigned)Val : Val);
+}
+
+void VarNode::Flatten(FlatAstBuilder &builder, bool negate) {
+  builder.AddTerm(Id, negate);
+}
+
+void SumNode::Flatten(FlatAstBuilder &builder, bool negate) {
+  builder.AddConstant(negate ? -(unsigned)Constant : Constant);
+  for (size_t i = 0; i < NumTerms; ++i) {
+    Terms[i].Expr->Flatten(builder, negate != (Terms[i].Op == SUB));
+  }
+}
+
+void SeqNode::Flatten(FlatAstBuilder &, uint32_t) {
+  // Последовательности раскрываются в FlatAstBuilder::AddBlock.
+  assert(false && "Sequence must be expanded into its block");
+}
+
+void AssignNode::Flatten(FlatAstBuilder &builder, uint32_t slot) {
+  builder.SetAssign(slot, Id, builder.AddExpr(RHS));
+}
+
+void IfNode::Flatten(FlatAstBuilder &builder, uint32_t slot) {
+  uint32_t CondExpr = builder.AddExpr(Cond);
+  uint32_t ThenBlock = builder.AddBlock(Then);
+  uint32_t ElseBlock = builder.AddBlock(Else);
+  builder.SetIf(slot, Op, CondExpr, ThenBlock, ElseBlock);
+}
+
+void PrintNode::Flatten(FlatAstBuilder &builder, uint32_t slot) {
+  builder.SetPrint(slot, builder.AddExpr(RHS));
+}
+
+void InputNode::Flatten(FlatAstBuilder &builder, uint32_t slot) {
+  builder.SetInput(slot, Id);
+}
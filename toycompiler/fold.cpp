@@ -0,0 +1,202 @@
+#include "fold.h"
+#include <unordered_map>
+
+// Состояние прохода
+// =====================================================================
+
+void FoldState::SetValue(unsigned id, KnownValue value) {
+  if (Values[id] == value) {
+    return;
+  }
+
+  // Вне ветвей откатывать нечего, и журнал не растет.
+  if (BranchDepth > 0) {
+    Trail.push_back(std::make_pair(id, Values[id]));
+  }
+
+  Values[id] = value;
+}
+
+size_t FoldState::BeginBranch() {
+  ++BranchDepth;
+  return Trail.size();
+}
+
+void FoldState::EndBranch(size_t mark, ValueList &changed) {
+  changed.clear();
+  for (size_t i = mark; i < Trail.size(); ++i) {
+    unsigned Id = Trail[i].first;
+    changed.push_back(std::make_pair(Id, Values[Id]));
+  }
+
+  while (Trail.size() > mark) {
+    Values[Trail.back().first] = Trail.back().second;
+    Trail.pop_back();
+  }
+
+  --BranchDepth;
+}
+
+void FoldState::MergeBranches(const ValueList &thenValues,
+                              const ValueList &elseValues) {
+  // Значения в конце ветви then; переменные, не тронутые в ветви,
+  // имеют значение, общее для обеих ветвей до условного оператора.
+  std::unordered_map<unsigned, KnownValue> ThenEnd(thenValues.begin(),
+                                                   thenValues.end());
+  std::unordered_map<unsigned, KnownValue> ElseEnd(elseValues.begin(),
+                                                   elseValues.end());
+
+  for (auto &entry : ThenEnd) {
+    auto It = ElseEnd.find(entry.first);
+    KnownValue Other = It != ElseEnd.end() ? It->second : Values[entry.first];
+    SetValue(entry.first, entry.second == Other ? Other : Unknown());
+  }
+
+  for (auto &entry : ElseEnd) {
+    if (ThenEnd.count(entry.first) == 0) {
+      KnownValue Before = Values[entry.first];
+      SetValue(entry.first, entry.second == Before ? Before : Unknown());
+    }
+  }
+}
+
+StmtNode *FoldConstants(StmtNode *Prog, FoldState &state) {
+  return Prog->Fold(state);
+}
+
+// Свертка выражений
+// =====================================================================
+
+ExprNode *VarNode::Fold(FoldState &state) {
+  KnownValue V = state.GetValue(Id);
+  if (!V.IsConst) {
+    return this;
+  }
+
+  ++state.FoldedExprs;
+  return state.Nodes.Create<ConstNode>(V.Value);
+}
+
+ExprNode *SumNode::Fold(FoldState &state) {
+  // Сумма считается по модулю 2^32, как и в сгенерированном коде.
+  unsigned Sum = Constant;
+  bool Changed = false;
+  state.Terms.clear();
+
+  for (size_t i = 0; i < NumTerms; ++i) {
+    ExprNode *Expr = Terms[i].Expr->Fold(state);
+    int Val;
+    if (Expr->GetConstValue(Val)) {
+      if (Terms[i].Op == ADD) {
+        Sum += Val;
+      } else {
+        Sum -= Val;
+      }
+
+      Changed = true;
+    } else {
+      SumNode::Term T = {Terms[i].Op, Expr};
+      state.Terms.push_back(T);
+      Changed = Changed || Expr != Terms[i].Expr;
+    }
+  }
+
+  if (!Changed) {
+    return this;
+  }
+
+  ++state.FoldedExprs;
+  if (state.Terms.empty()) {
+    return state.Nodes.Create<ConstNode>((int)Sum);
+  }
+
+  if (state.Terms.size() == 1 && state.Terms[0].Op == ADD && Sum == 0) {
+    return state.Terms[0].Expr;
+  }
+
+  return state.Nodes.Create<SumNode>(
+      (int)Sum, state.Nodes.CopyArray(state.Terms.data(), state.Terms.size()),
+      state.Terms.size());
+}
+
+// Свертка операторов
+// =====================================================================
+
+StmtNode *SeqNode::Fold(FoldState &state) {
+  for (auto &stmt : Statements) {
+    stmt = stmt->Fold(state);
+  }
+
+  return this;
+}
+
+StmtNode *AssignNode::Fold(FoldState &state) {
+  RHS = RHS->Fold(state);
+
+  int Val;
+  if (RHS->GetConstValue(Val)) {
+    state.SetValue(Id, FoldState::Const(Val));
+  } else {
+    state.SetValue(Id, FoldState::Unknown());
+  }
+
+  return this;
+}
+
+// Результат проверки знака известного значения.
+static bool CompareSign(CompareOp op, int val) {
+  switch (op) {
+  case NEGATIVE:
+    return val < 0;
+  case ZERO:
+    return val == 0;
+  case POSITIVE:
+    return val > 0;
+  }
+
+  return false;
+}
+
+StmtNode *IfNode::Fold(FoldState &state) {
+  Cond = Cond->Fold(state);
+
+  // Условие известно - остается только одна ветвь.
+  int Val;
+  if (Cond->GetConstValue(Val)) {
+    ++state.RemovedBranches;
+    if (CompareSign(Op, Val)) {
+      return Then->Fold(state);
+    }
+
+    if (Else != nullptr) {
+      return Else->Fold(state);
+    }
+
+    return state.Nodes.Create<SeqNode>();
+  }
+
+  FoldState::ValueList ThenValues, ElseValues;
+
+  size_t Mark = state.BeginBranch();
+  Then = Then->Fold(state);
+  state.EndBranch(Mark, ThenValues);
+
+  if (Else != nullptr) {
+    Mark = state.BeginBranch();
+    Else = Else->Fold(state);
+    state.EndBranch(Mark, ElseValues);
+  }
+
+  state.MergeBranches(ThenValues, ElseValues);
+  return this;
+}
+
+StmtNode *PrintNode::Fold(FoldState &state) {
+  RHS = RHS->Fold(state);
+  return this;
+}
+
+StmtNode *InputNode::Fold(FoldState &state) {
+  state.SetValue(Id, FoldState::Unknown());
+  return this;
+}
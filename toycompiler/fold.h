@@ -0,0 +1,85 @@
+#pragma once
+
+#include "arena.h"
+#include "ast.h"
+#include <utility>
+#include <vector>
+
+// Свертка констант и удаление недостижимых ветвей.
+//
+// Проход по дереву распространяет известные значения переменных
+// вдоль последовательности операторов, подставляет их в выражения,
+// складывает константы и заменяет условные операторы с известным
+// при компиляции условием той ветвью, которая выполнится.
+
+// Значение переменной, известное (или нет) в текущей точке программы.
+struct KnownValue {
+  bool IsConst;
+  int Value;
+
+  bool operator==(const KnownValue &other) const {
+    return IsConst == other.IsConst && (!IsConst || Value == other.Value);
+  }
+  bool operator!=(const KnownValue &other) const { return !(*this == other); }
+};
+
+class FoldState {
+public:
+  typedef std::vector<std::pair<unsigned, KnownValue>> ValueList;
+
+  FoldState(Arena &nodes, size_t numVars)
+      : Nodes(nodes), FoldedExprs(0), RemovedBranches(0),
+        Values(numVars, Unknown()), BranchDepth(0) {}
+
+  // Арена для новых узлов, появляющихся при свертке.
+  Arena &Nodes;
+
+  static KnownValue Unknown() {
+    KnownValue V = {false, 0};
+    return V;
+  }
+
+  static KnownValue Const(int value) {
+    KnownValue V = {true, value};
+    return V;
+  }
+
+  KnownValue GetValue(unsigned id) const { return Values[id]; }
+  void SetValue(unsigned id, KnownValue value);
+
+  // Новые переменные, появившиеся при потоковом разборе, неизвестны.
+  void AddVariables(size_t numVars) {
+    if (numVars > Values.size()) {
+      Values.resize(numVars, Unknown());
+    }
+  }
+
+  // Ветви условного оператора. Каждая ветвь обрабатывается от общего
+  // начального состояния: BeginBranch запоминает его, EndBranch
+  // возвращает к нему и выдает значения, изменившиеся в ветви.
+  size_t BeginBranch();
+  void EndBranch(size_t mark, ValueList &changed);
+
+  // Слияние двух ветвей: переменная остается известной, только если
+  // в конце обеих ветвей у нее одно и то же значение.
+  void MergeBranches(const ValueList &thenValues,
+                     const ValueList &elseValues);
+
+  // Буфер слагаемых для пересборки сумм.
+  std::vector<SumNode::Term> Terms;
+
+  // Статистика
+  unsigned FoldedExprs;
+  unsigned RemovedBranches;
+
+private:
+  std::vector<KnownValue> Values;
+
+  // Журнал изменений внутри ветвей для отката: номер переменной
+  // и ее прежнее значение.
+  ValueList Trail;
+  unsigned BranchDepth;
+};
+
+// Запуск прохода над всей программой.
+StmtNode *FoldConstants(StmtNode *Prog, FoldState &state);
@@ -1,17 +1,26 @@
 #pragma once
 
+#include "profile.h"
 #include <llvm/Analysis/Verifier.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
-#include <map>
-#include <set>
+#include <cassert>
 #include <string>
+#include <utility>
+#include <vector>
 
 using namespace llvm;
 
+class StmtNode;
+class VariableTable;
+
+// Состояние генератора одной компиляции. Все типы и константы создаются
+// в переданном контексте LLVM, поэтому компиляции с разными контекстами
+// могут идти параллельно в разных потоках.
 class GeneratorState {
 public:
+  LLVMContext &Context;
   IRBuilder<> *Builder;
   Module *MainModule;
 
@@ -20,26 +29,56 @@ public:
   Function *BuiltinPrint;
   Function *BuiltinInput;
 
-  std::map<std::string, AllocaInst *> Variables;
+  // Функция, в которую сейчас генерируется код: main или одна
+  // из частей длинной программы.
+  Function *Current;
+
+  // Общий кадр переменных (i32*) внутри части программы и в main,
+  // вызывающем части; nullptr, если программа не разбита на части.
+  Value *Frame;
+
+  // Ячейки переменных, индексированные номерами из VariableTable.
+  std::vector<AllocaInst *> Variables;
+
+  // Таблица для переменных, создаваемых при первом обращении.
+  const VariableTable *Symbols;
+
+  // Прямое построение SSA вместо ячеек (см. ReadVar). Задается до
+  // начала генерации.
+  bool DirectSSA;
 
-  GeneratorState() {
-    Builder = new IRBuilder<>(getGlobalContext());
-    MainModule = new Module("toycompiler", getGlobalContext());
+  // Счетчики и веса ветвей (см. profile.h). Задается до начала
+  // генерации.
+  ProfileOptions Profiling;
 
-    CreatePrototypes();
+  // Без withMain модуль содержит только части программы, а main
+  // генерируется в другом модуле.
+  GeneratorState(LLVMContext &context, bool withMain = true)
+      : Context(context), Frame(nullptr), Symbols(nullptr), DirectSSA(false),
+        MainFrame(nullptr), ResumeBlock(nullptr), BranchDepth(0), Epoch(0),
+        NumBranches(0), Counters(nullptr) {
+    Builder = new IRBuilder<>(Context);
+    MainModule = new Module("toycompiler", Context);
+
+    CreatePrototypes(withMain);
   }
 
   ~GeneratorState() {
+    delete Builder;
     Main = nullptr;
     BuiltinPrint = nullptr;
     BuiltinInput = nullptr;
   }
 
-  LLVMContext &GetContext() { return getGlobalContext(); }
+  LLVMContext &GetContext() { return Context; }
 
   bool Verify() { return verifyModule(*MainModule); }
   
-  void Optimize();
+  // Оптимизация модуля с уровнем 0..3 (как -O0..-O3).
+  void Optimize(unsigned level);
+
+  // Число инструкций IR во всех функциях модуля.
+  size_t CountInstructions() const;
 
   IRBuilder<> *GetBuilder() const { return Builder; }
 
@@ -47,13 +86,146 @@ public:
 
   BasicBlock *GetMainEntryBlock() const { return &Main->getEntryBlock(); }
 
-  AllocaInst *GetVar(const std::string &name) { return Variables[name]; }
+  AllocaInst *GetVar(unsigned id) {
+    if (id >= Variables.size() || Variables[id] == nullptr) {
+      return CreateVar(id);
+    }
 
-  void AddVar(const std::string &name, AllocaInst *var) {
-    Variables[name] = var;
+    return Variables[id];
   }
-  void AddVariables(const std::set<std::string> &Variables);
+
+  void AddVar(unsigned id, AllocaInst *var) { Variables[id] = var; }
+
+  // Ячейки для всех переменных таблицы сразу (в режиме DirectSSA
+  // ячейки не нужны, запоминается только таблица).
+  void AddVariables(const VariableTable &Vars);
+
+  // Ячейки создаются при первом обращении к переменной (потоковая
+  // генерация, когда таблица еще пополняется).
+  void AddVariablesLazily(const VariableTable &Vars) { Symbols = &Vars; }
+
+  // Чтение и запись переменных
+  // ------------------------------------------------------------------
+  // С ячейками чтение - это load, а запись - store; от них избавляет
+  // mem2reg при оптимизации. В режиме DirectSSA ячеек нет: генератор
+  // помнит текущее значение каждой переменной, а в блоке слияния
+  // условного оператора создает phi для переменных, которые изменились
+  // в ветвях. Циклов в языке нет, поэтому других мест слияния нет.
+  // Значение непрочитанной и неприсвоенной переменной не определено,
+  // как и у ячейки без записи; внутри части программы оно читается
+  // из кадра.
+  Value *ReadVar(unsigned id, const std::string &name = std::string());
+  void WriteVar(unsigned id, Value *value);
+
+  typedef std::vector<std::pair<unsigned, Value *>> ValueList;
+
+  // Ветви условного оператора. Каждая ветвь генерируется от общего
+  // начального состояния: BeginBranch запоминает его, EndBranch
+  // возвращает к нему и выдает значения, изменившиеся в ветви.
+  // MergeBranches вызывается в начале пустого блока слияния.
+  // С ячейками все три ничего не делают.
+  size_t BeginBranch();
+  void EndBranch(size_t mark, ValueList &changed);
+  void MergeBranches(BasicBlock *thenEnd, const ValueList &thenValues,
+                     BasicBlock *elseEnd, const ValueList &elseValues);
+
+  // Условный оператор
+  // ------------------------------------------------------------------
+  // Общий для обхода дерева и плоского AST порядок: BeginIf создает
+  // сравнение op (CompareOp из ast.h) значения arg с нулем, переход
+  // по нему и ставит генерацию в ветвь then, BeginElse - в ветвь else,
+  // EndIf - в блок слияния.
+  struct IfState {
+    unsigned Branch;
+    size_t Mark;
+    BasicBlock *Else, *Merge, *ThenEnd;
+    ValueList ThenValues;
+  };
+
+  void BeginIf(unsigned op, Value *arg, IfState &state);
+  void BeginElse(IfState &state);
+  void EndIf(IfState &state);
+
+  // Профиль ветвлений
+  // ------------------------------------------------------------------
+  // Условные операторы получают номера от NextBranch в порядке
+  // генерации. BranchWeights - веса для условного перехода (nullptr,
+  // если профиля нет или оператор в нем ни разу не выполнялся),
+  // CountBranch - увеличение счетчика ветви в текущем блоке.
+  // FinishProfile создает массив счетчиков и регистрирует его в main;
+  // если профиль не подошел к программе, веса снимаются.
+  unsigned NextBranch() { return NumBranches++; }
+  MDNode *BranchWeights(unsigned branch);
+  void CountBranch(unsigned branch, bool thenArm);
+  void FinishProfile();
+
+  // Разбиение программы на части
+  // ------------------------------------------------------------------
+  // Длинная программа делится на функции-части void(i32 *frame), которые
+  // main вызывает по порядку. Переменные хранятся в общем кадре main;
+  // внутри части они копируются в локальные ячейки при первом обращении
+  // и возвращаются в кадр в конце части, если были изменены.
+
+  // Кадр для numVars переменных во входном блоке main.
+  void CreateFrame(size_t numVars);
+  void SetFrameSize(size_t numVars);
+
+  // Функция-часть. Общая (shared) часть видна из других модулей,
+  // остальные внутренние. Части не встраиваются обратно в main.
+  Function *CreateChunk(const std::string &name, bool shared);
+
+  // Генерация тела части; после EndChunk код снова идет в main.
+  void BeginChunk(Function *chunk);
+  void EndChunk();
+
+  // Вызов части из main с общим кадром.
+  void CallChunk(Function *chunk);
 
 private:
-  void CreatePrototypes();
+  AllocaInst *MainFrame;
+  BasicBlock *ResumeBlock;
+
+  // Состояние DirectSSA: текущие и начальные значения переменных,
+  // журнал изменений внутри ветвей для отката (номер переменной и ее
+  // прежнее значение) и рабочие массивы слияния.
+  std::vector<Value *> Values;
+  std::vector<Value *> InitialValues;
+  ValueList Trail;
+  unsigned BranchDepth;
+  std::vector<Value *> MergeValues;
+  std::vector<unsigned> Marks;
+  unsigned Epoch;
+
+  // Число пронумерованных условных операторов и временный массив
+  // счетчиков, размер которого станет известен в FinishProfile.
+  unsigned NumBranches;
+  GlobalVariable *Counters;
+
+  void CreatePrototypes(bool withMain);
+  AllocaInst *CreateVar(unsigned id);
+
+  void GrowValues(unsigned id);
+  Value *InitialValue(unsigned id);
+  void SetValue(unsigned id, Value *value);
 };
+
+class CompileStats;
+
+// Имя функции-части с заданным номером.
+std::string ChunkName(size_t index);
+
+// Генерация операторов [begin, end) верхнего уровня по chunkSize штук
+// в функции-части. Номера частей считаются от начала программы, поэтому
+// begin должен быть кратен chunkSize. Если в модуле есть main, части
+// сразу вызываются из него.
+void GenerateChunks(GeneratorState &Gen, const std::vector<StmtNode *> &Stmts,
+                    size_t Begin, size_t End, unsigned ChunkSize,
+                    bool Shared);
+
+// Завершение main, компоновка стандартной библиотеки (если WithRuntime)
+// и оптимизация. SharedRuntime - модуль одна из частей программы, и
+// состояние библиотеки общее с другими частями (см. LinkRuntime).
+// Возвращает готовый модуль, которым дальше владеет вызывающий, или
+// nullptr при ошибке.
+Module *FinishModule(GeneratorState &Gen, unsigned OptLevel, bool WithRuntime,
+                     CompileStats *Stats, bool SharedRuntime = false);
@@ -0,0 +1,39 @@
+#include "jit.h"
+#include "toystd.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JIT.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/TargetSelect.h>
+
+using namespace llvm;
+
+bool RunJIT(Module *module) {
+  InitializeNativeTarget();
+
+  std::string Error;
+  ExecutionEngine *Engine = EngineBuilder(module)
+                                .setErrorStr(&Error)
+                                .setEngineKind(EngineKind::JIT)
+                                .setOptLevel(CodeGenOpt::Default)
+                                .create();
+  if (Engine == nullptr) {
+    std::cerr << "JIT error: " << Error << std::endl;
+    return false;
+  }
+
+  // Встроенные функции берем из самого процесса, без поиска символов.
+  Engine->addGlobalMapping(module->getFunction("builtin_print"),
+                           reinterpret_cast<void *>(&builtin_print));
+  Engine->addGlobalMapping(module->getFunction("builtin_input"),
+                           reinterpret_cast<void *>(&builtin_input));
+
+  void *Main = Engine->getPointerToFunction(module->getFunction("main"));
+  reinterpret_cast<void (*)()>(Main)();
+  builtin_flush();
+
+  delete Engine;
+  return true;
+}
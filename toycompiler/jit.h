@@ -0,0 +1,11 @@
+#pragma once
+
+namespace llvm {
+class Module;
+}
+
+// Исполнение сгенерированного модуля JIT-компилятором в текущем
+// процессе. Встроенные функции связываются с реализациями из toystd.c,
+// скомпонованными в сам компилятор. Модуль переходит во владение
+// исполняющей среды. Возвращает false в случае ошибки.
+bool RunJIT(llvm::Module *module);
@@ -0,0 +1,81 @@
+#include "objemit.h"
+#include <memory>
+#include <mutex>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Module.h>
+#include <llvm/PassManager.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+
+using namespace llvm;
+
+static CodeGenOpt::Level GetCodeGenLevel(unsigned optLevel) {
+  switch (optLevel) {
+  case 0:
+    return CodeGenOpt::None;
+  case 1:
+    return CodeGenOpt::Less;
+  case 2:
+    return CodeGenOpt::Default;
+  default:
+    return CodeGenOpt::Aggressive;
+  }
+}
+
+bool EmitObjectFile(Module *module, const std::string &path,
+                    unsigned optLevel, std::string &error) {
+  // Регистрация целевой платформы выполняется один раз на процесс,
+  // даже если объектные файлы создаются из нескольких потоков.
+  static std::once_flag TargetInitialized;
+  std::call_once(TargetInitialized, []() {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+  });
+
+  std::string Triple = sys::getDefaultTargetTriple();
+  const Target *TheTarget = TargetRegistry::lookupTarget(Triple, error);
+  if (TheTarget == nullptr) {
+    return false;
+  }
+
+  // Позиционно-независимый код компонуется и в обычные,
+  // и в PIE-исполняемые файлы.
+  TargetOptions Options;
+  std::unique_ptr<TargetMachine> Machine(TheTarget->createTargetMachine(
+      Triple, sys::getHostCPUName(), "", Options, Reloc::PIC_,
+      CodeModel::Default, GetCodeGenLevel(optLevel)));
+  if (!Machine) {
+    error = "cannot create target machine for " + Triple;
+    return false;
+  }
+
+  module->setTargetTriple(Triple);
+
+  PassManager PM;
+  PM.add(new DataLayout(*Machine->getDataLayout()));
+
+  tool_output_file Out(path.c_str(), error, sys::fs::F_Binary);
+  if (!error.empty()) {
+    return false;
+  }
+
+  {
+    formatted_raw_ostream OS(Out.os());
+    if (Machine->addPassesToEmitFile(PM, OS,
+                                     TargetMachine::CGFT_ObjectFile)) {
+      error = "target does not support object file emission";
+      return false;
+    }
+
+    PM.run(*module);
+  }
+
+  Out.keep();
+  return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+namespace llvm {
+class Module;
+}
+
+// Генерация объектного файла для текущей платформы прямо в процессе
+// компилятора, без llc и промежуточного ассемблерного текста.
+// optLevel (0..3) задает уровень оптимизации генератора машинного кода.
+// Путь "-" означает stdout. При ошибке возвращает false, а причину
+// записывает в error.
+bool EmitObjectFile(llvm::Module *module, const std::string &path,
+                    unsigned optLevel, std::string &error);
@@ -0,0 +1,237 @@
+#include "parallelparse.h"
+#include "bufferlexer.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// Предварительный просмотр
+// =====================================================================
+
+static bool IsWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9');
+}
+
+std::vector<size_t> FindChunkBoundaries(const char *begin, const char *end,
+                                        size_t minChunk, size_t maxChunks) {
+  std::vector<size_t> Boundaries(1, 0);
+  size_t Target = (end - begin) / maxChunks;
+  if (Target < minChunk) {
+    Target = minChunk;
+  }
+
+  long Depth = 0;
+  // Предыдущая лексема может завершать оператор (переменная, константа
+  // или end), и после нее был перевод строки.
+  bool Terminal = false;
+  bool Newline = false;
+  size_t Next = Target;
+
+  for (const char *p = begin; p < end;) {
+    char c = *p;
+    if (c == '\n' || c == '\r') {
+      Newline = true;
+      ++p;
+      continue;
+    }
+
+    if (c == ' ' || c == '\t') {
+      ++p;
+      continue;
+    }
+
+    if (c >= '0' && c <= '9') {
+      while (p < end && *p >= '0' && *p <= '9') {
+        ++p;
+      }
+      Terminal = true;
+      Newline = false;
+      continue;
+    }
+
+    if (!IsWordChar(c)) {
+      // Знаки операций и прочие символы оператор не завершают.
+      Terminal = false;
+      Newline = false;
+      ++p;
+      continue;
+    }
+
+    const char *Word = p;
+    while (p < end && IsWordChar(*p)) {
+      ++p;
+    }
+
+    int Kind = KeywordToken(Word, p - Word);
+    bool Starts = Kind == tok_if || Kind == tok_input || Kind == tok_print;
+    if (Kind == tok_identifier) {
+      // Переменная начинает присваивание, только если за ней идет '='.
+      const char *q = p;
+      while (q < end && (*q == ' ' || *q == '\t')) {
+        ++q;
+      }
+      Starts = q < end && *q == '=';
+    }
+
+    size_t Offset = Word - begin;
+    if (Depth == 0 && Terminal && Newline && Starts && Offset >= Next &&
+        Boundaries.size() < maxChunks) {
+      Boundaries.push_back(Offset);
+      Next = Offset + Target;
+    }
+
+    if (Kind == tok_if) {
+      ++Depth;
+    } else if (Kind == tok_end && --Depth < 0) {
+      return std::vector<size_t>();
+    }
+
+    Terminal = Kind == tok_identifier || Kind == tok_end;
+    Newline = false;
+  }
+
+  if (Depth != 0) {
+    return std::vector<size_t>();
+  }
+
+  return Boundaries;
+}
+
+// Перенумерация переменных
+// =====================================================================
+
+void VarNode::RenumberVariables(const std::vector<unsigned> &ids) {
+  Id = ids[Id];
+}
+
+void SumNode::RenumberVariables(const std::vector<unsigned> &ids) {
+  for (size_t i = 0; i < NumTerms; ++i) {
+    Terms[i].Expr->RenumberVariables(ids);
+  }
+}
+
+void SeqNode::RenumberVariables(const std::vector<unsigned> &ids) {
+  for (auto stmt : Statements) {
+    stmt->RenumberVariables(ids);
+  }
+}
+
+void AssignNode::RenumberVariables(const std::vector<unsigned> &ids) {
+  Id = ids[Id];
+  RHS->RenumberVariables(ids);
+}
+
+void IfNode::RenumberVariables(const std::vector<unsigned> &ids) {
+  Cond->RenumberVariables(ids);
+  Then->RenumberVariables(ids);
+  if (Else != nullptr) {
+    Else->RenumberVariables(ids);
+  }
+}
+
+void PrintNode::RenumberVariables(const std::vector<unsigned> &ids) {
+  RHS->RenumberVariables(ids);
+}
+
+void InputNode::RenumberVariables(const std::vector<unsigned> &ids) {
+  Id = ids[Id];
+}
+
+// Разбор
+// =====================================================================
+
+// Куски меньше этого размера не стоят отдельного потока.
+static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+StmtNode *ParseParallel(const char *begin, const char *end, Arena &nodes,
+                        VariableTable &symbols, unsigned jobs, bool &success,
+                        size_t &chunks) {
+  // Кусков больше, чем потоков, чтобы потоки загружались равномерно.
+  std::vector<size_t> Bounds =
+      jobs > 1 ? FindChunkBoundaries(begin, end, MIN_CHUNK_SIZE, jobs * 4)
+               : std::vector<size_t>();
+  if (Bounds.size() < 2) {
+    chunks = 1;
+    BufferLexer Lex(begin, end, symbols);
+    Parser P(Lex, nodes, symbols);
+    StmtNode *Prog = P.Parse();
+    success = P.ParserSuccess();
+    return Prog;
+  }
+
+  chunks = Bounds.size();
+  Bounds.push_back(end - begin);
+
+  // Таблицы кусков живут в общей арене: на их имена ссылаются узлы.
+  std::vector<VariableTable *> Tables(chunks);
+  std::vector<std::unique_ptr<Arena>> Arenas(chunks);
+  std::vector<StmtNode *> Results(chunks);
+  std::unique_ptr<bool[]> Valid(new bool[chunks]);
+  for (size_t i = 0; i < chunks; ++i) {
+    Tables[i] = nodes.Create<VariableTable>();
+    Arenas[i].reset(new Arena());
+  }
+
+  std::atomic<size_t> Next(0);
+  auto Worker = [&]() {
+    for (size_t i; (i = Next++) < chunks;) {
+      BufferLexer Lex(begin + Bounds[i], begin + Bounds[i + 1], *Tables[i]);
+      Parser P(Lex, *Arenas[i], *Tables[i]);
+      Results[i] = P.Parse();
+      Valid[i] = P.ParserSuccess();
+    }
+  };
+
+  std::vector<std::thread> Workers;
+  for (size_t i = 1; i < jobs && i < chunks; ++i) {
+    Workers.push_back(std::thread(Worker));
+  }
+  Worker();
+  for (auto &worker : Workers) {
+    worker.join();
+  }
+
+  // Слияние таблиц по порядку кусков сохраняет порядок первого появления.
+  std::vector<std::vector<unsigned>> Ids(chunks);
+  for (size_t i = 0; i < chunks; ++i) {
+    for (unsigned id = 0; id < Tables[i]->Size(); ++id) {
+      Ids[i].push_back(symbols.Intern(Tables[i]->GetName(id)));
+    }
+  }
+
+  Next = 0;
+  auto Renumber = [&]() {
+    for (size_t i; (i = Next++) < chunks;) {
+      Results[i]->RenumberVariables(Ids[i]);
+    }
+  };
+
+  Workers.clear();
+  for (size_t i = 1; i < jobs && i < chunks; ++i) {
+    Workers.push_back(std::thread(Renumber));
+  }
+  Renumber();
+  for (auto &worker : Workers) {
+    worker.join();
+  }
+
+  // Операторы кусков собираются в общую последовательность. Кусок
+  // с ошибкой добавляется целиком, вместе с сообщением.
+  SeqNode *Prog = nodes.Create<SeqNode>();
+  success = true;
+  for (size_t i = 0; i < chunks; ++i) {
+    SeqNode *Seq = dynamic_cast<SeqNode *>(Results[i]);
+    if (Valid[i] && Seq != nullptr) {
+      for (auto stmt : Seq->GetStatements()) {
+        Prog->Add(stmt);
+      }
+    } else {
+      Prog->Add(Results[i]);
+      success = false;
+    }
+
+    nodes.Adopt(*Arenas[i]);
+  }
+
+  return Prog;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "arena.h"
+#include "ast.h"
+#include "symbols.h"
+#include <cstddef>
+#include <vector>
+
+// Параллельный разбор большого исходного текста.
+//
+// Быстрый предварительный просмотр находит границы операторов верхнего
+// уровня: начало строки вне if ... end, где предыдущий оператор уже
+// закончен, а следующий начинается. По этим границам текст режется на
+// куски, которые разбираются независимо в нескольких потоках, каждый со
+// своей ареной и своей таблицей переменных. Затем таблицы сливаются в
+// общую (номера переменных получаются те же, что и при обычном разборе),
+// номера в деревьях кусков заменяются на общие, а операторы кусков
+// собираются в одну последовательность верхнего уровня.
+
+// Смещения начал кусков (первый всегда 0), не меньше minChunk байт
+// в каждом, не больше maxChunks кусков. Пустой результат означает, что
+// текст нельзя разрезать надежно (например, if и end не сбалансированы).
+std::vector<size_t> FindChunkBoundaries(const char *begin, const char *end,
+                                        size_t minChunk, size_t maxChunks);
+
+// Разбор текста в jobs потоков. Деревья и имена переменных переходят
+// во владение арены nodes, переменные заносятся в symbols. Признак
+// успешного разбора записывается в success. chunks - число кусков,
+// на которые был разрезан текст (1, если параллельного разбора не было).
+StmtNode *ParseParallel(const char *begin, const char *end, Arena &nodes,
+                        VariableTable &symbols, unsigned jobs, bool &success,
+                        size_t &chunks);
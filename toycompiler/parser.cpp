@@ -1,6 +1,7 @@
 #include "parser.h"
 
 #include <cctype>
+#include <cstring>
 #include <ios>
 #include <sstream>
 
@@ -9,6 +10,57 @@
 
 static int isnewline(int c) { return (c == '\n' || c == '\r'); }
 
+int KeywordToken(const char *name, size_t length) {
+  // Ключевые слова различаются длиной и первой буквой,
+  // поэтому достаточно одного сравнения строк.
+  const char *Keyword = nullptr;
+  int Token = tok_identifier;
+
+  switch (length) {
+  case 2:
+    if (name[0] == 'i' && name[1] == 's')
+      return tok_is;
+    if (name[0] == 'i' && name[1] == 'f')
+      return tok_if;
+    return tok_identifier;
+  case 3:
+    Keyword = "end";
+    Token = tok_end;
+    break;
+  case 4:
+    if (name[0] == 'e') {
+      Keyword = "else";
+      Token = tok_else;
+    } else {
+      Keyword = "zero";
+      Token = tok_zero;
+    }
+    break;
+  case 5:
+    if (name[0] == 'i') {
+      Keyword = "input";
+      Token = tok_input;
+    } else {
+      Keyword = "print";
+      Token = tok_print;
+    }
+    break;
+  case 8:
+    if (name[0] == 'n') {
+      Keyword = "negative";
+      Token = tok_negative;
+    } else {
+      Keyword = "positive";
+      Token = tok_positive;
+    }
+    break;
+  default:
+    return tok_identifier;
+  }
+
+  return memcmp(name, Keyword, length) == 0 ? Token : tok_identifier;
+}
+
 int Lexer::GetToken() {
   // Пропускаем ведущие пробелы и символы табуляции.
   while (LastChar == ' ' || LastChar == '\t') {
@@ -23,26 +75,12 @@ int Lexer::GetToken() {
     }
 
     // Ключевые слова
-    if (IdentifierName == "is")
-      return tok_is;
-    if (IdentifierName == "if")
-      return tok_if;
-    if (IdentifierName == "else")
-      return tok_else;
-    if (IdentifierName == "end")
-      return tok_end;
-    if (IdentifierName == "negative")
-      return tok_negative;
-    if (IdentifierName == "zero")
-      return tok_zero;
-    if (IdentifierName == "positive")
-      return tok_positive;
-    if (IdentifierName == "input")
-      return tok_input;
-    if (IdentifierName == "print")
-      return tok_print;
+    int Keyword = KeywordToken(IdentifierName.data(), IdentifierName.size());
+    if (Keyword != tok_identifier)
+      return Keyword;
 
     // Если никакое ключевое слово не подошло, это идентификатор.
+    IdentifierId = Symbols.Intern(IdentifierName);
     return tok_identifier;
   }
 
@@ -149,7 +187,7 @@ static std::string Expected(const std::string &msg, int found) {
 StmtNode *Parser::Parse() {
   auto Stmt = ParseSeq();
   if (CurrentToken != tok_eof) {
-    auto Prog = new SeqNode();
+    auto Prog = Nodes.Create<SeqNode>();
     Prog->Add(Stmt);
     Prog->Add(StmtError(Expected("End of file", CurrentToken)));
     return Prog;
@@ -158,13 +196,29 @@ StmtNode *Parser::Parse() {
   return Stmt;
 }
 
+StmtNode *Parser::ParseNext() {
+  SkipNewline();
+  if (CurrentToken == tok_identifier || CurrentToken == tok_if ||
+      CurrentToken == tok_input || CurrentToken == tok_print) {
+    return ParseStmt();
+  }
+
+  if (CurrentToken != tok_eof) {
+    int FoundToken = CurrentToken;
+    NextToken();
+    return StmtError(Expected("End of file", FoundToken));
+  }
+
+  return nullptr;
+}
+
 StmtNode *Parser::ParseStmt() {
   if (CurrentToken == tok_identifier) {
-    std::string IdName = Lex->IdentifierName;
+    unsigned Id = Lex.IdentifierId;
     NextToken();
     if (CurrentToken == '=') {
       NextToken();
-      return new AssignNode(IdName, ParseExpr());
+      return Nodes.Create<AssignNode>(Id, Symbols.GetName(Id), ParseExpr());
     } else {
       SkipAssign();
       return StmtError(Expected("'='", CurrentToken));
@@ -193,7 +247,7 @@ StmtNode *Parser::ParseStmt() {
 
         if (CurrentToken == tok_end) {
           NextToken();
-          return new IfNode(Op, Cond, Then, Else);
+          return Nodes.Create<IfNode>(Op, Cond, Then, Else);
         } else { // Должна быть лексема tok_end (или tok_else).
           return StmtError(Expected("'end' or 'else'", CurrentToken));
         }
@@ -212,7 +266,8 @@ StmtNode *Parser::ParseStmt() {
     NextToken();
     SkipNewline();
     if (CurrentToken == tok_identifier) {
-      auto Stmt = new InputNode(Lex->IdentifierName);
+      auto Stmt = Nodes.Create<InputNode>(
+          Lex.IdentifierId, Symbols.GetName(Lex.IdentifierId));
       NextToken();
       return Stmt;
     } else {
@@ -221,7 +276,7 @@ StmtNode *Parser::ParseStmt() {
   } else if (CurrentToken == tok_print) {
     NextToken();
     SkipNewline();
-    return new PrintNode(ParseExpr());
+    return Nodes.Create<PrintNode>(ParseExpr());
   } else {
     // Этот код на самом деле никогда не выполняется,
     // так как в ParseSeq есть проверка на то,
@@ -234,7 +289,7 @@ StmtNode *Parser::ParseStmt() {
 }
 
 StmtNode *Parser::ParseSeq() {
-  auto Seq = new SeqNode();
+  auto Seq = Nodes.Create<SeqNode>();
 
   while (true) {
     // Пропускаем переводы строки,
@@ -258,38 +313,59 @@ StmtNode *Parser::ParseSeq() {
 }
 
 ExprNode *Parser::ParseExpr() {
-  ExprNode *Expr = nullptr;
-
-  if (CurrentToken == tok_const) {
-    Expr = new ConstNode(Lex->ConstValue);
-  } else if (CurrentToken == tok_identifier) {
-    Expr = new VarNode(Lex->IdentifierName);
-  } else { // Ошибка, сообщаем и выходим.
-    return ExprError(Expected("Constant or variable", CurrentToken));
-  }
-
-  NextToken();
-  SkipNewline();
-  while (CurrentToken == '+' || CurrentToken == '-') {
-    BinaryOp Op = ParseBinaryOp(CurrentToken);
-    NextToken();
-    SkipNewline();
+  // Константы сразу складываются в свободный член (с переполнением
+  // по модулю 2^32, как и в сгенерированном коде), а переменные
+  // накапливаются в плоском списке слагаемых.
+  unsigned Constant = 0;
+  BinaryOp Op = ADD;
+  bool First = true;
+  Terms.clear();
+
+  for (;; First = false) {
     if (CurrentToken == tok_const) {
-      Expr = new BinaryNode(Op, Expr, new ConstNode(Lex->ConstValue));
+      if (Op == ADD) {
+        Constant += Lex.ConstValue;
+      } else {
+        Constant -= Lex.ConstValue;
+      }
     } else if (CurrentToken == tok_identifier) {
-      Expr = new BinaryNode(Op, Expr, new VarNode(Lex->IdentifierName));
+      SumNode::Term T = {Op, Nodes.Create<VarNode>(
+                                 Lex.IdentifierId,
+                                 Symbols.GetName(Lex.IdentifierId))};
+      Terms.push_back(T);
+    } else if (First) {
+      // Ошибка в начале выражения, сообщаем и выходим.
+      return ExprError(Expected("Constant or variable", CurrentToken));
     } else {
       // Ошибка: после знака операции нет выражения.
-      Expr = new BinaryNode(
-          Op, Expr, ExprError(Expected("Constant or variable", CurrentToken)));
-      return Expr;
+      SumNode::Term T = {
+          Op, ExprError(Expected("Constant or variable", CurrentToken))};
+      Terms.push_back(T);
+      break;
     }
 
     NextToken();
     SkipNewline();
+    if (CurrentToken != '+' && CurrentToken != '-') {
+      break;
+    }
+
+    Op = ParseBinaryOp(CurrentToken);
+    NextToken();
+    SkipNewline();
+  }
+
+  // Одиночные константа и переменная не нуждаются в узле суммы.
+  if (Terms.empty()) {
+    return Nodes.Create<ConstNode>((int)Constant);
+  }
+
+  if (Terms.size() == 1 && Terms[0].Op == ADD && Constant == 0) {
+    return Terms[0].Expr;
   }
 
-  return Expr;
+  return Nodes.Create<SumNode>(
+      (int)Constant, Nodes.CopyArray(Terms.data(), Terms.size()), Terms.size());
 }
 
 void Parser::SkipAssign() {
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "arena.h"
 #include "ast.h"
+#include "symbols.h"
 #include <string>
 #include <istream>
 #include <iostream>
@@ -34,23 +36,42 @@ enum Token {
   tok_print = -13
 };
 
-// Лексический анализатор.
-class Lexer {
+// Лексема ключевого слова или tok_identifier, если это не ключевое слово.
+// Выполняется за константное время.
+int KeywordToken(const char *name, size_t length);
+
+// Источник лексем для синтаксического анализатора.
+class TokenSource {
+public:
+  TokenSource() : IdentifierId(0), ConstValue(0) {}
+  virtual ~TokenSource() {}
+
+  // Получение очередной лексемы.
+  virtual int GetToken() = 0;
+
+  // Публично доступные атрибуты лексемы.
+  unsigned IdentifierId;
+  int ConstValue;
+};
+
+// Лексический анализатор, читающий поток посимвольно.
+// Идентификаторы сразу интернируются в таблицу переменных.
+class Lexer : public TokenSource {
   std::istream &Input;
+  VariableTable &Symbols;
   int LastChar;
 
 public:
-  Lexer(std::istream &input)
-      : Input(input), LastChar(' '), IdentifierName(""), ConstValue(0) {}
+  Lexer(std::istream &input, VariableTable &symbols)
+      : Input(input), Symbols(symbols), LastChar(' '), IdentifierName("") {}
 
   ~Lexer() {}
 
   // Получение очередной лексемы из потока.
-  int GetToken();
+  virtual int GetToken();
 
-  // Публично доступные атрибуты лексемы.
+  // Имя последнего прочитанного идентификатора.
   std::string IdentifierName;
-  int ConstValue;
 };
 
 // Синтаксический анализатор.
@@ -64,24 +85,33 @@ public:
  *         'then' Seq ['else' Seq] 'end'
  *       | 'input' Var
  *       | 'print' Var
- * Expr -> (const | ident) (('+' | '-') Expr)*
+ * Expr -> (const | ident) (('+' | '-') (const | ident))*
  */
 
+// Все узлы дерева создаются в арене, переданной в конструктор,
+// и живут столько же, сколько она. Переменные программы
+// собираются в таблицу symbols.
 class Parser {
-  std::istream &Input;
-  Lexer *Lex;
+  TokenSource &Lex;
+  Arena &Nodes;
+  VariableTable &Symbols;
   int CurrentToken;
 
 public:
-  Parser(std::istream &input) : Input(input), ProgramIsValid(true) {
-    Lex = new Lexer(Input);
+  Parser(TokenSource &lex, Arena &nodes, VariableTable &symbols)
+      : Lex(lex), Nodes(nodes), Symbols(symbols), ProgramIsValid(true) {
     NextToken();
   }
 
-  ~Parser() { delete Lex; }
+  ~Parser() {}
 
   // Запуск синтаксического анализатора.
   StmtNode *Parse();
+
+  // Разбор программы по одному оператору верхнего уровня: возвращает
+  // очередной оператор или nullptr в конце программы. Лишняя лексема
+  // на верхнем уровне возвращается как ошибочный оператор.
+  StmtNode *ParseNext();
   bool ParserSuccess() const { return ProgramIsValid; }
 
 private:
@@ -90,7 +120,7 @@ private:
   StmtNode *ParseStmt();
   ExprNode *ParseExpr();
 
-  void NextToken() { CurrentToken = Lex->GetToken(); }
+  void NextToken() { CurrentToken = Lex.GetToken(); }
 
   void SkipNewline() {
     while (CurrentToken == tok_newline) {
@@ -98,17 +128,20 @@ private:
     }
   }
 
+  // Слагаемые разбираемого выражения (буфер переиспользуется).
+  std::vector<SumNode::Term> Terms;
+
   // Обработка ошибок
   bool ProgramIsValid;
 
   StmtNode *StmtError(const std::string &message) {
     ProgramIsValid = false;
-    return new StmtErrorNode(message);
+    return Nodes.Create<StmtErrorNode>(message);
   }
 
   ExprNode *ExprError(const std::string &message) {
     ProgramIsValid = false;
-    return new ExprErrorNode(message);
+    return Nodes.Create<ExprErrorNode>(message);
   }
 
   void SkipAssign();
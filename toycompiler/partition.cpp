@@ -0,0 +1,137 @@
+#include "partition.h"
+#include "ast.h"
+#include "generator.h"
+#include "objemit.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <thread>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/Threading.h>
+
+extern char **environ;
+
+// Запуск ld -r для объединения объектных файлов частей.
+static bool MergeObjects(const std::vector<std::string> &inputs,
+                         const std::string &output, std::string &error) {
+  const char *Linker = getenv("TOY_LD");
+  if (Linker == nullptr || *Linker == '\0') {
+    Linker = "ld";
+  }
+
+  std::vector<char *> Args;
+  Args.push_back(const_cast<char *>(Linker));
+  Args.push_back(const_cast<char *>("-r"));
+  Args.push_back(const_cast<char *>("-o"));
+  Args.push_back(const_cast<char *>(output.c_str()));
+  for (auto &input : inputs) {
+    Args.push_back(const_cast<char *>(input.c_str()));
+  }
+  Args.push_back(nullptr);
+
+  pid_t Pid;
+  int Err = posix_spawnp(&Pid, Linker, nullptr, nullptr, Args.data(), environ);
+  if (Err != 0) {
+    error = std::string("Cannot run ") + Linker + ": " + strerror(Err);
+    return false;
+  }
+
+  int Status;
+  while (waitpid(Pid, &Status, 0) < 0) {
+    if (errno != EINTR) {
+      error = std::string("waitpid: ") + strerror(errno);
+      return false;
+    }
+  }
+
+  if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0) {
+    error = std::string(Linker) + " -r failed";
+    return false;
+  }
+
+  return true;
+}
+
+bool EmitPartitioned(const std::vector<StmtNode *> &stmts,
+                     const VariableTable &vars, unsigned optLevel,
+                     bool withRuntime, bool directSSA, unsigned chunkSize,
+                     unsigned jobs, const std::string &outputPath,
+                     std::string &error) {
+  size_t NumChunks = (stmts.size() + chunkSize - 1) / chunkSize;
+  size_t NumParts = std::max<size_t>(1, std::min<size_t>(jobs, NumChunks));
+
+  // Модуль с номером NumParts - это main.
+  std::vector<std::string> Objects(NumParts + 1);
+  for (size_t i = 0; i <= NumParts; ++i) {
+    Objects[i] = outputPath + ".part" + std::to_string(i) + ".o";
+  }
+
+  llvm_start_multithreaded();
+
+  std::atomic<size_t> Next(0);
+  std::mutex ErrorLock;
+  bool Failed = false;
+
+  auto Worker = [&]() {
+    for (size_t Part; (Part = Next++) <= NumParts;) {
+      LLVMContext Context;
+      bool IsMain = Part == NumParts;
+      GeneratorState Gen(Context, IsMain);
+      Gen.DirectSSA = directSSA;
+      Gen.AddVariablesLazily(vars);
+
+      if (IsMain) {
+        Gen.CreateFrame(vars.Size());
+        for (size_t c = 0; c < NumChunks; ++c) {
+          Gen.CallChunk(Gen.CreateChunk(ChunkName(c), true));
+        }
+      } else {
+        // Части делятся между модулями поровну, целыми функциями.
+        size_t First = Part * NumChunks / NumParts * chunkSize;
+        size_t Last = (Part + 1) * NumChunks / NumParts * chunkSize;
+        GenerateChunks(Gen, stmts, First, std::min(Last, stmts.size()),
+                       chunkSize, true);
+      }
+
+      // Библиотека компонуется в каждый модуль, чтобы builtin_print
+      // и builtin_input встраивались и в части.
+      std::unique_ptr<Module> Partition(
+          FinishModule(Gen, optLevel, withRuntime, nullptr, true));
+      std::string Error;
+      bool Written =
+          Partition &&
+          EmitObjectFile(Partition.get(), Objects[Part], optLevel, Error);
+      if (!Written) {
+        std::lock_guard<std::mutex> Guard(ErrorLock);
+        Failed = true;
+        if (error.empty()) {
+          error = Partition ? Error : "Cannot generate partition";
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> Workers;
+  size_t Threads = std::min<size_t>(jobs, NumParts + 1);
+  for (size_t i = 1; i < Threads; ++i) {
+    Workers.push_back(std::thread(Worker));
+  }
+  Worker();
+  for (auto &worker : Workers) {
+    worker.join();
+  }
+
+  bool Merged = !Failed && MergeObjects(Objects, outputPath, error);
+  for (auto &object : Objects) {
+    std::remove(object.c_str());
+  }
+
+  return Merged;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+class StmtNode;
+class VariableTable;
+
+// Параллельная генерация объектного файла для длинной программы.
+//
+// Операторы верхнего уровня делятся на функции-части по chunkSize штук,
+// части - на jobs модулей, а main с общим кадром переменных
+// составляет отдельный модуль. Стандартная библиотека (если
+// withRuntime) компонуется в каждый модуль. Каждый модуль строится
+// в своем контексте LLVM, оптимизируется и переводится в машинный код
+// в своем потоке; затем объектные файлы объединяются в outputPath
+// командой ld -r (программа задается переменной окружения TOY_LD).
+// directSSA - режим генерации (см. GeneratorState::DirectSSA). При
+// ошибке возвращает false, а причину записывает в error.
+bool EmitPartitioned(const std::vector<StmtNode *> &stmts,
+                     const VariableTable &vars, unsigned optLevel,
+                     bool withRuntime, bool directSSA, unsigned chunkSize,
+                     unsigned jobs, const std::string &outputPath,
+                     std::string &error);
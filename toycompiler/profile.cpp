@@ -0,0 +1,32 @@
+#include "profile.h"
+#include <fstream>
+
+bool BranchProfile::Load(const std::string &path, std::string &error) {
+  std::ifstream In(path.c_str());
+  if (!In.is_open()) {
+    error = path + ": cannot open profile";
+    return false;
+  }
+
+  std::string Magic;
+  size_t Branches;
+  if (!(In >> Magic >> Branches) || Magic != "toyprofile") {
+    error = path + ": not a branch profile";
+    return false;
+  }
+
+  // Счетчики добавляются по мере чтения, так что испорченное число
+  // условных операторов в заголовке не заставит выделить лишнюю память.
+  Counts.clear();
+  for (size_t i = 0; i < Branches; ++i) {
+    uint64_t Then, Else;
+    if (!(In >> Then >> Else)) {
+      error = path + ": truncated profile";
+      return false;
+    }
+
+    Counts.push_back(std::make_pair(Then, Else));
+  }
+
+  return true;
+}
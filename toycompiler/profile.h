@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Профиль ветвлений.
+//
+// Программа, собранная с --profile-generate, считает выполнения каждой
+// ветви каждого условного оператора и при завершении записывает
+// счетчики в файл профиля (см. builtin_profile в toystd.h). Если файл
+// уже есть и относится к программе с тем же числом условных
+// операторов, счетчики прибавляются к записанным, так что несколько
+// запусков дают общий профиль.
+//
+// При компиляции с --profile-use счетчики становятся весами ветвей
+// (метаданные !prof), по которым LLVM располагает блоки и решает,
+// заменять ли ветвление выбором значения.
+//
+// Условные операторы нумеруются в порядке генерации кода, поэтому
+// профиль подходит только к той же программе, скомпилированной
+// с теми же параметрами свертки. Файл текстовый:
+//
+//   toyprofile <число условных операторов>
+//   <then> <else>    - по строке на условный оператор
+class BranchProfile {
+public:
+  // Число выполнений ветвей then и else по номерам условных операторов.
+  std::vector<std::pair<uint64_t, uint64_t>> Counts;
+
+  bool Load(const std::string &path, std::string &error);
+};
+
+// Профилирование при генерации кода.
+struct ProfileOptions {
+  // Файл, в который инструментированная программа запишет профиль;
+  // пустая строка - без счетчиков.
+  std::string GeneratePath;
+
+  // Профиль, по которому расставляются веса ветвей; nullptr - без весов.
+  const BranchProfile *Use;
+
+  ProfileOptions() : Use(nullptr) {}
+
+  bool Enabled() const { return !GeneratePath.empty() || Use != nullptr; }
+};
@@ -0,0 +1,445 @@
+#include "range.h"
+#include <algorithm>
+#include <unordered_map>
+
+// Интервалы и линейные формы
+// =====================================================================
+
+static Interval Intersect(Interval a, Interval b) {
+  return Interval::Range(std::max(a.Lo, b.Lo), std::min(a.Hi, b.Hi));
+}
+
+static Interval Hull(Interval a, Interval b) {
+  return Interval::Range(std::min(a.Lo, b.Lo), std::max(a.Hi, b.Hi));
+}
+
+static Interval Shift(Interval a, int64_t delta) {
+  return Interval::Range(a.Lo + delta, a.Hi + delta);
+}
+
+static bool Fits(Interval a) { return a.Lo >= INT32_MIN && a.Hi <= INT32_MAX; }
+
+// Интервал -a. Смена знака переводит INT32_MIN в себя же, поэтому
+// интервал с этим значением становится полным.
+static Interval Negate(Interval a) {
+  if (a.Lo == INT32_MIN) {
+    return Interval::Full();
+  }
+
+  return Interval::Range(-a.Hi, -a.Lo);
+}
+
+void LinearForm::Normalize() {
+  std::sort(Terms.begin(), Terms.end());
+
+  size_t Count = 0;
+  for (size_t i = 0; i < Terms.size(); ++i) {
+    if (Count > 0 && Terms[Count - 1].first == Terms[i].first) {
+      Terms[Count - 1].second += Terms[i].second;
+    } else {
+      Terms[Count++] = Terms[i];
+    }
+  }
+  Terms.resize(Count);
+
+  Terms.erase(std::remove_if(Terms.begin(), Terms.end(),
+                             [](const std::pair<unsigned, int64_t> &term) {
+                               return term.second == 0;
+                             }),
+              Terms.end());
+}
+
+// Состояние прохода
+// =====================================================================
+
+// Предел для границ промежуточной суммы: пока он не превышен, очередное
+// слагаемое (коэффициент до 2^30 на значение до 2^31) не переполнит
+// 64 бита.
+static const int64_t CoefLimit = INT64_C(1) << 30;
+static const int64_t SumLimit = INT64_C(1) << 62;
+
+Interval RangeState::Evaluate(const LinearForm &form) const {
+  Interval Sum = Interval::Range(0, 0);
+  for (auto &term : form.Terms) {
+    int64_t Coef = term.second;
+    if (Coef > CoefLimit || Coef < -CoefLimit) {
+      return Interval::Full();
+    }
+
+    Interval Range = Ranges[term.first];
+    if (Coef > 0) {
+      Sum.Lo += Coef * Range.Lo;
+      Sum.Hi += Coef * Range.Hi;
+    } else {
+      Sum.Lo += Coef * Range.Hi;
+      Sum.Hi += Coef * Range.Lo;
+    }
+
+    if (Sum.Lo < -SumLimit || Sum.Hi > SumLimit) {
+      return Interval::Full();
+    }
+  }
+
+  // Сумма без переполнения совпадает с суммой по модулю 2^32.
+  int64_t Constant = static_cast<int32_t>(form.Constant);
+  Interval Result = Shift(Sum, Constant);
+  if (!Fits(Result)) {
+    Result = Interval::Full();
+  }
+
+  if (form.Terms.empty()) {
+    return Result;
+  }
+
+  bool Negated = form.Terms[0].second < 0;
+  ptrdiff_t Index = FindFact(form.Terms, Negated);
+  if (Index >= 0) {
+    Interval Known = Facts[Index].Range;
+    if (Negated) {
+      Known = Negate(Known);
+    }
+
+    Known = Shift(Known, Constant);
+    if (Fits(Known)) {
+      Result = Intersect(Result, Known);
+    }
+  }
+
+  return Result;
+}
+
+void RangeState::Assume(const LinearForm &form, Interval range) {
+  if (form.Terms.empty() || range.IsEmpty()) {
+    return;
+  }
+
+  // Интервал суммы без свободного члена. Если сдвиг выходит за пределы
+  // int32, значения суммы по модулю 2^32 интервалом не описываются.
+  Interval Sum = Shift(range, -static_cast<int64_t>(
+                                  static_cast<int32_t>(form.Constant)));
+  if (!Fits(Sum)) {
+    return;
+  }
+
+  bool Negated = form.Terms[0].second < 0;
+  if (Negated) {
+    Sum = Negate(Sum);
+    if (Sum.IsFull()) {
+      return;
+    }
+  }
+
+  // Условие на одну переменную сужает ее собственный интервал.
+  if (form.Terms.size() == 1 &&
+      (form.Terms[0].second == 1 || form.Terms[0].second == -1)) {
+    unsigned Id = form.Terms[0].first;
+    Interval Range = Intersect(Ranges[Id], Sum);
+    if (!Range.IsEmpty()) {
+      SetRange(Id, Range);
+    }
+    return;
+  }
+
+  ptrdiff_t Index = FindFact(form.Terms, Negated);
+  if (Index >= 0) {
+    Interval Range = Intersect(Facts[Index].Range, Sum);
+    if (!Range.IsEmpty()) {
+      SetFact(Index, Range);
+    }
+    return;
+  }
+
+  // Вне ветвей новые факты не заводятся: их некому было бы забыть,
+  // и список рос бы вместе с программой.
+  if (BranchDepth == 0) {
+    return;
+  }
+
+  Fact F;
+  F.Terms = form.Terms;
+  if (Negated) {
+    for (auto &term : F.Terms) {
+      term.second = -term.second;
+    }
+  }
+  F.Range = Sum;
+  Facts.push_back(F);
+}
+
+void RangeState::Assign(unsigned id, Interval range) {
+  SetRange(id, range);
+
+  for (size_t i = 0; i < Facts.size(); ++i) {
+    if (Facts[i].Range.IsFull()) {
+      continue;
+    }
+
+    for (auto &term : Facts[i].Terms) {
+      if (term.first == id) {
+        SetFact(i, Interval::Full());
+        break;
+      }
+    }
+  }
+}
+
+void RangeState::SetRange(unsigned id, Interval range) {
+  if (Ranges[id] == range) {
+    return;
+  }
+
+  // Вне ветвей откатывать нечего, и журнал не растет.
+  if (BranchDepth > 0) {
+    TrailEntry Entry = {false, id, Ranges[id]};
+    Trail.push_back(Entry);
+  }
+
+  Ranges[id] = range;
+}
+
+void RangeState::SetFact(size_t index, Interval range) {
+  if (Facts[index].Range == range) {
+    return;
+  }
+
+  if (BranchDepth > 0) {
+    TrailEntry Entry = {true, index, Facts[index].Range};
+    Trail.push_back(Entry);
+  }
+
+  Facts[index].Range = range;
+}
+
+ptrdiff_t RangeState::FindFact(const LinearForm::TermList &terms,
+                               bool negated) const {
+  int64_t Sign = negated ? -1 : 1;
+  for (size_t i = 0; i < Facts.size(); ++i) {
+    const LinearForm::TermList &Known = Facts[i].Terms;
+    if (Known.size() != terms.size()) {
+      continue;
+    }
+
+    bool Same = true;
+    for (size_t t = 0; t < terms.size() && Same; ++t) {
+      Same = Known[t].first == terms[t].first &&
+             Known[t].second == Sign * terms[t].second;
+    }
+
+    if (Same) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+RangeState::Mark RangeState::BeginBranch() {
+  ++BranchDepth;
+  return Mark(Trail.size(), Facts.size());
+}
+
+void RangeState::EndBranch(Mark mark, RangeList &changedRanges,
+                           FactList &changedFacts) {
+  changedRanges.clear();
+  changedFacts.clear();
+  for (size_t i = mark.first; i < Trail.size(); ++i) {
+    size_t Index = Trail[i].Index;
+    if (!Trail[i].IsFact) {
+      changedRanges.push_back(std::make_pair(Index, Ranges[Index]));
+    } else if (Index < mark.second) {
+      changedFacts.push_back(std::make_pair(Index, Facts[Index].Range));
+    }
+  }
+
+  while (Trail.size() > mark.first) {
+    const TrailEntry &Entry = Trail.back();
+    if (Entry.IsFact) {
+      Facts[Entry.Index].Range = Entry.Range;
+    } else {
+      Ranges[Entry.Index] = Entry.Range;
+    }
+    Trail.pop_back();
+  }
+
+  Facts.erase(Facts.begin() + mark.second, Facts.end());
+  --BranchDepth;
+}
+
+// Интервалы, покрывающие концы обеих ветвей. Интервал, не тронутый
+// в ветви, в ее конце равен начальному (before).
+template <typename Key, typename Before>
+static void MergeLists(const std::vector<std::pair<Key, Interval>> &thenList,
+                       const std::vector<std::pair<Key, Interval>> &elseList,
+                       Before before,
+                       std::vector<std::pair<Key, Interval>> &merged) {
+  std::unordered_map<Key, Interval> ThenEnd(thenList.begin(), thenList.end());
+  std::unordered_map<Key, Interval> ElseEnd(elseList.begin(), elseList.end());
+
+  merged.clear();
+  for (auto &entry : ThenEnd) {
+    auto It = ElseEnd.find(entry.first);
+    Interval Other = It != ElseEnd.end() ? It->second : before(entry.first);
+    merged.push_back(std::make_pair(entry.first, Hull(entry.second, Other)));
+  }
+
+  for (auto &entry : ElseEnd) {
+    if (ThenEnd.count(entry.first) == 0) {
+      merged.push_back(std::make_pair(
+          entry.first, Hull(entry.second, before(entry.first))));
+    }
+  }
+}
+
+void RangeState::MergeBranches(const RangeList &thenRanges,
+                               const FactList &thenFacts,
+                               const RangeList &elseRanges,
+                               const FactList &elseFacts) {
+  RangeList MergedRanges;
+  MergeLists(thenRanges, elseRanges,
+             [this](unsigned id) { return Ranges[id]; }, MergedRanges);
+  for (auto &entry : MergedRanges) {
+    SetRange(entry.first, entry.second);
+  }
+
+  FactList MergedFacts;
+  MergeLists(thenFacts, elseFacts,
+             [this](size_t index) { return Facts[index].Range; },
+             MergedFacts);
+  for (auto &entry : MergedFacts) {
+    SetFact(entry.first, entry.second);
+  }
+}
+
+StmtNode *PruneBranches(StmtNode *Prog, RangeState &state) {
+  return Prog->Prune(state);
+}
+
+// Линейные формы выражений
+// =====================================================================
+
+void ConstNode::Linearize(LinearForm &form, bool negate) {
+  unsigned Value = Val;
+  form.AddConstant(negate ? 0u - Value : Value);
+}
+
+void VarNode::Linearize(LinearForm &form, bool negate) {
+  form.AddTerm(Id, negate);
+}
+
+void SumNode::Linearize(LinearForm &form, bool negate) {
+  unsigned Value = Constant;
+  form.AddConstant(negate ? 0u - Value : Value);
+
+  for (size_t i = 0; i < NumTerms; ++i) {
+    Terms[i].Expr->Linearize(form, negate != (Terms[i].Op == SUB));
+  }
+}
+
+// Удаление ветвей
+// =====================================================================
+
+StmtNode *SeqNode::Prune(RangeState &state) {
+  for (auto &stmt : Statements) {
+    stmt = stmt->Prune(state);
+  }
+
+  return this;
+}
+
+StmtNode *AssignNode::Prune(RangeState &state) {
+  LinearForm &Form = state.Form;
+  Form.Clear();
+  RHS->Linearize(Form, false);
+  Form.Normalize();
+
+  state.Assign(Id, state.Evaluate(Form));
+  return this;
+}
+
+// Значения условия, при которых выполняется ветвь then.
+static Interval ThenRange(CompareOp op) {
+  switch (op) {
+  case NEGATIVE:
+    return Interval::Range(INT32_MIN, -1);
+  case ZERO:
+    return Interval::Range(0, 0);
+  case POSITIVE:
+    return Interval::Range(1, INT32_MAX);
+  }
+
+  return Interval::Full();
+}
+
+// Значения условия из интервала cond, при которых выполняется ветвь
+// else. Для ZERO это интервал, только если ноль - его край.
+static Interval ElseRange(CompareOp op, Interval cond) {
+  switch (op) {
+  case NEGATIVE:
+    return Interval::Range(0, INT32_MAX);
+  case ZERO:
+    if (cond.Lo == 0) {
+      return Interval::Range(1, INT32_MAX);
+    }
+    if (cond.Hi == 0) {
+      return Interval::Range(INT32_MIN, -1);
+    }
+    return Interval::Full();
+  case POSITIVE:
+    return Interval::Range(INT32_MIN, 0);
+  }
+
+  return Interval::Full();
+}
+
+StmtNode *IfNode::Prune(RangeState &state) {
+  // Форма условия нужна в обеих ветвях, а вложенные операторы
+  // используют общий буфер, поэтому она хранится здесь.
+  LinearForm Form;
+  Cond->Linearize(Form, false);
+  Form.Normalize();
+
+  Interval Value = state.Evaluate(Form);
+  Interval Taken = Intersect(Value, ThenRange(Op));
+
+  // Исход условия известен - остается только одна ветвь.
+  if (Taken == Value) {
+    ++state.RemovedBranches;
+    return Then->Prune(state);
+  }
+
+  if (Taken.IsEmpty()) {
+    ++state.RemovedBranches;
+    if (Else != nullptr) {
+      return Else->Prune(state);
+    }
+
+    return state.Nodes.Create<SeqNode>();
+  }
+
+  RangeState::RangeList ThenRanges, ElseRanges;
+  RangeState::FactList ThenFacts, ElseFacts;
+
+  RangeState::Mark Mark = state.BeginBranch();
+  state.Assume(Form, Taken);
+  Then = Then->Prune(state);
+  state.EndBranch(Mark, ThenRanges, ThenFacts);
+
+  // Даже без ветви else после оператора может оказаться, что условие
+  // было ложно, и это тоже сужает интервалы.
+  Mark = state.BeginBranch();
+  state.Assume(Form, Intersect(Value, ElseRange(Op, Value)));
+  if (Else != nullptr) {
+    Else = Else->Prune(state);
+  }
+  state.EndBranch(Mark, ElseRanges, ElseFacts);
+
+  state.MergeBranches(ThenRanges, ThenFacts, ElseRanges, ElseFacts);
+  return this;
+}
+
+StmtNode *PrintNode::Prune(RangeState &) { return this; }
+
+StmtNode *InputNode::Prune(RangeState &state) {
+  state.Assign(Id, Interval::Full());
+  return this;
+}
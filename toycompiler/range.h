@@ -0,0 +1,159 @@
+#pragma once
+
+#include "arena.h"
+#include "ast.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Анализ диапазонов значений и удаление ветвей с предрешенным условием.
+//
+// Проход по дереву сопоставляет каждой переменной интервал ее
+// возможных значений. Присваивание задает интервал по правой части,
+// ввод делает его полным, а внутри ветви условного оператора интервалы
+// сужаются условием или его отрицанием. После условного оператора
+// интервал переменной покрывает ее интервалы в конце обеих ветвей.
+//
+// Условие с несколькими переменными (например, y - z) запоминается
+// как факт о сумме этих переменных и действует внутри ветви, пока
+// ни одна из них не изменилась. Условный оператор, исход которого
+// следует из интервала условия, заменяется ветвью, которая выполнится.
+//
+// Сложение в программе выполняется по модулю 2^32, поэтому сумма,
+// которая может переполниться, получает полный интервал.
+
+// Интервал значений [Lo, Hi] в пределах int32. Границы хранятся
+// в 64 битах, чтобы переполнение при их сложении было видно.
+struct Interval {
+  int64_t Lo, Hi;
+
+  static Interval Full() {
+    Interval I = {INT32_MIN, INT32_MAX};
+    return I;
+  }
+
+  static Interval Range(int64_t lo, int64_t hi) {
+    Interval I = {lo, hi};
+    return I;
+  }
+
+  bool IsEmpty() const { return Lo > Hi; }
+  bool IsFull() const { return Lo == INT32_MIN && Hi == INT32_MAX; }
+
+  bool operator==(const Interval &other) const {
+    return Lo == other.Lo && Hi == other.Hi;
+  }
+  bool operator!=(const Interval &other) const { return !(*this == other); }
+};
+
+// Выражение в виде суммы переменных с коэффициентами и свободного
+// члена (по модулю 2^32). После Normalize слагаемые упорядочены
+// по номеру переменной, а нулевые коэффициенты удалены.
+struct LinearForm {
+  typedef std::vector<std::pair<unsigned, int64_t>> TermList;
+
+  unsigned Constant;
+  TermList Terms;
+
+  LinearForm() : Constant(0) {}
+
+  void Clear() {
+    Constant = 0;
+    Terms.clear();
+  }
+
+  void AddConstant(unsigned value) { Constant += value; }
+  void AddTerm(unsigned id, bool negate) {
+    Terms.push_back(std::make_pair(id, negate ? -1 : 1));
+  }
+
+  void Normalize();
+};
+
+class RangeState {
+public:
+  typedef std::vector<std::pair<unsigned, Interval>> RangeList;
+
+  // Факты, изменившиеся в ветви: номер факта и его интервал.
+  typedef std::vector<std::pair<size_t, Interval>> FactList;
+
+  // Начальное состояние ветви: длина журнала и число фактов.
+  typedef std::pair<size_t, size_t> Mark;
+
+  RangeState(Arena &nodes, size_t numVars)
+      : Nodes(nodes), RemovedBranches(0), Ranges(numVars, Interval::Full()),
+        BranchDepth(0) {}
+
+  // Арена для новых узлов, появляющихся при удалении ветвей.
+  Arena &Nodes;
+
+  // Новые переменные, появившиеся при потоковом разборе, могут иметь
+  // любое значение.
+  void AddVariables(size_t numVars) {
+    if (numVars > Ranges.size()) {
+      Ranges.resize(numVars, Interval::Full());
+    }
+  }
+
+  // Интервал значений нормализованной формы в текущей точке.
+  Interval Evaluate(const LinearForm &form) const;
+
+  // Сужение интервалов: значение нормализованной формы лежит в range.
+  void Assume(const LinearForm &form, Interval range);
+
+  // Новое значение переменной; факты с ней перестают действовать
+  // (их интервалы становятся полными).
+  void Assign(unsigned id, Interval range);
+
+  // Ветви условного оператора, как в FoldState: BeginBranch запоминает
+  // общее начальное состояние, EndBranch возвращает к нему и выдает
+  // интервалы и факты, изменившиеся в ветви. Факты, появившиеся
+  // в ветви, при выходе из нее забываются.
+  Mark BeginBranch();
+  void EndBranch(Mark mark, RangeList &changedRanges,
+                 FactList &changedFacts);
+
+  // Слияние двух ветвей: интервалы переменных и фактов покрывают
+  // их интервалы в конце обеих ветвей.
+  void MergeBranches(const RangeList &thenRanges, const FactList &thenFacts,
+                     const RangeList &elseRanges, const FactList &elseFacts);
+
+  // Буфер для формы правой части присваивания.
+  LinearForm Form;
+
+  // Статистика
+  unsigned RemovedBranches;
+
+private:
+  std::vector<Interval> Ranges;
+
+  // Факт - интервал суммы переменных без свободного члена. Первый
+  // коэффициент суммы положителен, так что y - z и z - y - один факт.
+  struct Fact {
+    LinearForm::TermList Terms;
+    Interval Range;
+  };
+
+  std::vector<Fact> Facts;
+
+  // Журнал изменений внутри ветвей для отката: переменная или факт
+  // и прежний интервал.
+  struct TrailEntry {
+    bool IsFact;
+    size_t Index;
+    Interval Range;
+  };
+
+  std::vector<TrailEntry> Trail;
+  unsigned BranchDepth;
+
+  void SetRange(unsigned id, Interval range);
+  void SetFact(size_t index, Interval range);
+
+  // Факт о сумме terms (при negated - о сумме -terms) или -1.
+  ptrdiff_t FindFact(const LinearForm::TermList &terms, bool negated) const;
+};
+
+// Запуск прохода над всей программой.
+StmtNode *PruneBranches(StmtNode *Prog, RangeState &state);
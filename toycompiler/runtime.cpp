@@ -0,0 +1,79 @@
+#include "runtime.h"
+#include <memory>
+#include <set>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+using namespace llvm;
+
+// Биткод toystd.bc, встроенный в компилятор командой ld -r -b binary.
+extern "C" {
+extern const char _binary_toystd_bc_start[];
+extern const char _binary_toystd_bc_end[];
+}
+
+const char *GetRuntimeBitcode(size_t &size) {
+  size = _binary_toystd_bc_end - _binary_toystd_bc_start;
+  return _binary_toystd_bc_start;
+}
+
+bool LinkRuntime(Module *module, bool shared, std::string &error) {
+  size_t Size;
+  const char *Data = GetRuntimeBitcode(Size);
+  StringRef Bitcode(Data, Size);
+  std::unique_ptr<MemoryBuffer> Buffer(
+      MemoryBuffer::getMemBuffer(Bitcode, "toystd.bc", false));
+
+  // Модуль библиотеки создается в контексте программы: модули из разных
+  // контекстов скомпоновать нельзя.
+  std::unique_ptr<Module> Runtime(
+      ParseBitcodeFile(Buffer.get(), module->getContext(), &error));
+  if (!Runtime) {
+    return false;
+  }
+
+  // Открытые функции и данные библиотеки.
+  std::set<std::string> Exports;
+  for (auto &F : *Runtime) {
+    if (!F.isDeclaration() && !F.hasLocalLinkage()) {
+      Exports.insert(F.getName());
+    }
+  }
+
+  std::set<std::string> Globals;
+  for (Module::global_iterator G = Runtime->global_begin(),
+                               E = Runtime->global_end();
+       G != E; ++G) {
+    if (!G->isDeclaration() && !G->hasLocalLinkage()) {
+      Globals.insert(G->getName());
+    }
+  }
+
+  if (Linker::LinkModules(module, Runtime.get(), Linker::DestroySource,
+                          &error)) {
+    return false;
+  }
+
+  // Функции библиотеки не видны снаружи программы. Функции самой
+  // программы (main, toy_batch и т.п.) сохраняют свое связывание.
+  for (auto &name : Exports) {
+    module->getFunction(name)->setLinkage(GlobalValue::InternalLinkage);
+  }
+
+  // Состояние библиотеки в частях программы - слабое скрытое
+  // определение: при объединении частей от него остается одна копия
+  // на всю программу.
+  for (auto &name : Globals) {
+    GlobalVariable *G = module->getNamedGlobal(name);
+    if (shared) {
+      G->setLinkage(GlobalValue::WeakAnyLinkage);
+      G->setVisibility(GlobalValue::HiddenVisibility);
+    } else {
+      G->setLinkage(GlobalValue::InternalLinkage);
+    }
+  }
+
+  return true;
+}
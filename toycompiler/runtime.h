@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace llvm {
+class Module;
+}
+
+// Компоновка стандартной библиотеки (toystd.c) в модуль программы.
+// Биткод библиотеки встроен в сам компилятор. После компоновки функции
+// библиотеки получают внутреннее связывание, и оптимизатор может
+// встраивать builtin_print и builtin_input в main. Функции самой
+// программы, в том числе toy_batch (см. batch.h), остаются видимыми.
+// Буферы ввода-вывода остаются единственными на всю программу.
+//
+// Если shared, модуль - одна из нескольких частей программы (см.
+// partition.h). Библиотека компонуется в каждую часть, чтобы и там
+// встроенные функции можно было встраивать, а ее состояние (буферы
+// ввода-вывода) получает слабое скрытое связывание: после объединения
+// объектных файлов частей оно остается одним на всю программу и не
+// видно вне ее. При ошибке возвращает false, а причину записывает
+// в error.
+bool LinkRuntime(llvm::Module *module, bool shared, std::string &error);
+
+// Встроенный биткод библиотеки; size - его размер в байтах.
+const char *GetRuntimeBitcode(size_t &size);
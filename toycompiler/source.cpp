@@ -0,0 +1,123 @@
+#include "source.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::~SourceBuffer() {
+  if (Mapped) {
+    munmap(const_cast<char *>(Data), Length);
+  }
+}
+
+bool SourceBuffer::Open(const char *path, std::string &error) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    error = std::string(path) + ": " + strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    error = std::string(path) + ": " + strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  // Каналы и устройства отобразить нельзя - читаем их как поток.
+  if (!S_ISREG(st.st_mode)) {
+    bool Ok = Read(fd, error);
+    close(fd);
+    return Ok;
+  }
+
+  if ((size_t)st.st_size > MAX_SIZE) {
+    error = std::string(path) + ": source file is too large";
+    close(fd);
+    return false;
+  }
+
+  Length = st.st_size;
+  if (Length == 0) {
+    // Пустой файл отобразить нельзя, но и не нужно.
+    Data = "";
+    close(fd);
+    return true;
+  }
+
+  void *Addr = mmap(nullptr, Length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (Addr == MAP_FAILED) {
+    error = std::string(path) + ": " + strerror(errno);
+    Length = 0;
+    return false;
+  }
+
+  // Файл читается один раз от начала до конца.
+  madvise(Addr, Length, MADV_SEQUENTIAL);
+
+  Data = static_cast<const char *>(Addr);
+  Mapped = true;
+  return true;
+}
+
+bool SourceBuffer::Read(int fd, std::string &error) {
+  size_t Used = 0;
+
+  while (true) {
+    if (Storage.size() - Used < READ_BLOCK_SIZE) {
+      Storage.resize(Used + READ_BLOCK_SIZE);
+    }
+
+    ssize_t Count = read(fd, Storage.data() + Used, READ_BLOCK_SIZE);
+    if (Count < 0) {
+      if (errno == EINTR)
+        continue;
+      error = strerror(errno);
+      return false;
+    }
+
+    if (Count == 0)
+      break;
+
+    Used += Count;
+    if (Used > MAX_SIZE) {
+      error = "source is too large";
+      return false;
+    }
+  }
+
+  Storage.resize(Used);
+  Data = Storage.data();
+  Length = Used;
+  return true;
+}
+
+bool SourceBuffer::Read(std::istream &in, std::string &error) {
+  size_t Used = 0;
+
+  while (in) {
+    if (Storage.size() - Used < READ_BLOCK_SIZE) {
+      Storage.resize(Used + READ_BLOCK_SIZE);
+    }
+
+    in.read(Storage.data() + Used, READ_BLOCK_SIZE);
+    Used += in.gcount();
+    if (Used > MAX_SIZE) {
+      error = "source is too large";
+      return false;
+    }
+  }
+
+  if (in.bad()) {
+    error = "cannot read source";
+    return false;
+  }
+
+  Storage.resize(Used);
+  Data = Storage.data();
+  Length = Used;
+  return true;
+}
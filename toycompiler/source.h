@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Исходный текст программы, целиком находящийся в памяти.
+//
+// Файл отображается в память (mmap) без копирования; поток,
+// который отобразить нельзя (stdin, канал), читается крупными блоками.
+class SourceBuffer {
+  const char *Data;
+  size_t Length;
+  bool Mapped;
+  std::vector<char> Storage;
+
+public:
+  // Размер блока при чтении из потока.
+  static const size_t READ_BLOCK_SIZE = 1 << 20;
+
+  // Максимальный размер исходного текста: смещения лексем 32-битные.
+  static const size_t MAX_SIZE = 0xFFFFFFFFu;
+
+  SourceBuffer() : Data(nullptr), Length(0), Mapped(false) {}
+  ~SourceBuffer();
+
+  // Загрузка файла. При ошибке возвращает false, а причину
+  // записывает в error.
+  bool Open(const char *path, std::string &error);
+
+  // Чтение всего содержимого открытого файлового дескриптора
+  // или потока.
+  bool Read(int fd, std::string &error);
+  bool Read(std::istream &in, std::string &error);
+
+  const char *Begin() const { return Data; }
+  const char *End() const { return Data + Length; }
+  size_t Size() const { return Length; }
+
+private:
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+};
@@ -0,0 +1,132 @@
+#include "stats.h"
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sys/resource.h>
+
+// Подсчет выделений памяти
+// =====================================================================
+
+// Счетчики общие для всего процесса, включая выделения внутри LLVM.
+// Пока подсчет не включен (без --stats), operator new только читает
+// флаг и не пишет в общую память.
+static std::atomic<bool> CountingEnabled(false);
+static std::atomic<uint64_t> AllocationCount(0);
+static std::atomic<uint64_t> AllocatedBytes(0);
+
+static void *CountedAlloc(size_t size) {
+  if (CountingEnabled.load(std::memory_order_relaxed)) {
+    AllocationCount.fetch_add(1, std::memory_order_relaxed);
+    AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  }
+
+  void *Ptr = std::malloc(size != 0 ? size : 1);
+  if (Ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  return Ptr;
+}
+
+void *operator new(size_t size) { return CountedAlloc(size); }
+
+void *operator new[](size_t size) { return CountedAlloc(size); }
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+void CompileStats::EnableAllocationCounting() {
+  CountingEnabled.store(true, std::memory_order_relaxed);
+}
+
+uint64_t CompileStats::GetAllocationCount() {
+  return AllocationCount.load(std::memory_order_relaxed);
+}
+
+uint64_t CompileStats::GetAllocatedBytes() {
+  return AllocatedBytes.load(std::memory_order_relaxed);
+}
+
+long CompileStats::GetPeakRssKb() {
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) != 0) {
+    return 0;
+  }
+
+  return Usage.ru_maxrss;
+}
+
+// Фазы и счетчики
+// =====================================================================
+
+void CompileStats::BeginPhase(const char *name) {
+  if (InPhase) {
+    EndPhase();
+  }
+
+  InPhase = true;
+  CurrentName = name;
+  StartAllocations = GetAllocationCount();
+  StartBytes = GetAllocatedBytes();
+  StartPeakRssKb = GetPeakRssKb();
+  Start = std::chrono::steady_clock::now();
+}
+
+void CompileStats::EndPhase() {
+  if (!InPhase) {
+    return;
+  }
+
+  auto Elapsed = std::chrono::steady_clock::now() - Start;
+  InPhase = false;
+
+  Phase P;
+  P.Name = CurrentName;
+  P.WallMs = std::chrono::duration<double, std::milli>(Elapsed).count();
+  P.Allocations = GetAllocationCount() - StartAllocations;
+  P.AllocatedBytes = GetAllocatedBytes() - StartBytes;
+  P.PeakRssGrowthKb = GetPeakRssKb() - StartPeakRssKb;
+  Phases.push_back(P);
+}
+
+void CompileStats::SetCounter(const std::string &name, uint64_t value) {
+  for (auto &counter : Counters) {
+    if (counter.first == name) {
+      counter.second = value;
+      return;
+    }
+  }
+
+  Counters.push_back(std::make_pair(name, value));
+}
+
+void CompileStats::WriteJSON(std::ostream &out) const {
+  double Total = 0;
+  for (auto &phase : Phases) {
+    Total += phase.WallMs;
+  }
+
+  out << std::fixed << std::setprecision(3);
+  out << "{" << std::endl;
+  out << "  \"phases\": [";
+  for (size_t i = 0; i < Phases.size(); ++i) {
+    const Phase &P = Phases[i];
+    out << (i > 0 ? "," : "") << std::endl;
+    out << "    {\"name\": \"" << P.Name << "\", \"wall_ms\": " << P.WallMs
+        << ", \"allocations\": " << P.Allocations
+        << ", \"allocated_bytes\": " << P.AllocatedBytes
+        << ", \"peak_rss_growth_kb\": " << P.PeakRssGrowthKb << "}";
+  }
+  out << std::endl << "  ]," << std::endl;
+
+  for (auto &counter : Counters) {
+    out << "  \"" << counter.first << "\": " << counter.second << ","
+        << std::endl;
+  }
+
+  out << "  \"total_wall_ms\": " << Total << "," << std::endl;
+  out << "  \"peak_rss_kb\": " << GetPeakRssKb() << std::endl;
+  out << "}" << std::endl;
+}
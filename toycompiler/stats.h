@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Статистика компиляции: время, выделения памяти и рост пикового
+// объема памяти по фазам, а также произвольные счетчики (размер
+// дерева, число инструкций IR и т.п.). Выводится в формате JSON.
+class CompileStats {
+public:
+  struct Phase {
+    std::string Name;
+    double WallMs;
+    uint64_t Allocations;
+    uint64_t AllocatedBytes;
+    // Насколько фаза подняла пиковый RSS процесса. Пик процесса не
+    // уменьшается, поэтому фаза, уложившаяся в память, уже занятую
+    // раньше, получает 0, даже если сама использовала много памяти.
+    long PeakRssGrowthKb;
+  };
+
+  CompileStats() : InPhase(false) {}
+
+  void BeginPhase(const char *name);
+  void EndPhase();
+
+  void SetCounter(const std::string &name, uint64_t value);
+
+  void WriteJSON(std::ostream &out) const;
+
+  // Включение подсчета выделений через operator new. Без него
+  // operator new не трогает общие счетчики, и статистика выделений
+  // по фазам нулевая.
+  static void EnableAllocationCounting();
+
+  // Общее число выделений через operator new и их объем с момента
+  // включения подсчета.
+  static uint64_t GetAllocationCount();
+  static uint64_t GetAllocatedBytes();
+
+  // Пиковый объем резидентной памяти процесса с начала работы, КиБ.
+  static long GetPeakRssKb();
+
+private:
+  std::vector<Phase> Phases;
+  std::vector<std::pair<std::string, uint64_t>> Counters;
+
+  bool InPhase;
+  std::string CurrentName;
+  std::chrono::steady_clock::time_point Start;
+  uint64_t StartAllocations;
+  uint64_t StartBytes;
+  long StartPeakRssKb;
+};
+
+// Замер одной фазы в пределах области видимости.
+// При stats == nullptr ничего не делает.
+class PhaseTimer {
+  CompileStats *Stats;
+
+public:
+  PhaseTimer(CompileStats *stats, const char *name) : Stats(stats) {
+    if (Stats != nullptr) {
+      Stats->BeginPhase(name);
+    }
+  }
+
+  ~PhaseTimer() {
+    if (Stats != nullptr) {
+      Stats->EndPhase();
+    }
+  }
+};
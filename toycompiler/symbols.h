@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cassert>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+// Таблица переменных программы.
+//
+// Идентификаторы интернируются лексическим анализатором: каждое имя
+// получает плотный целочисленный номер в порядке первого появления,
+// и дальше узлы дерева и генератор работают только с номерами.
+// Имена хранятся в std::deque, поэтому ссылки на них не инвалидируются
+// при добавлении новых переменных.
+class VariableTable {
+  std::deque<std::string> Names;
+  std::unordered_map<std::string, unsigned> Ids;
+
+public:
+  VariableTable() {}
+
+  // Номер переменной с данным именем (новое имя получает следующий номер).
+  unsigned Intern(const std::string &name) {
+    auto It = Ids.find(name);
+    if (It != Ids.end()) {
+      return It->second;
+    }
+
+    unsigned Id = Names.size();
+    Names.push_back(name);
+    Ids.emplace(name, Id);
+    return Id;
+  }
+
+  const std::string &GetName(unsigned id) const {
+    assert(id < Names.size() && "Unknown variable id");
+    return Names[id];
+  }
+
+  size_t Size() const { return Names.size(); }
+};
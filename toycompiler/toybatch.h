@@ -0,0 +1,40 @@
+#ifndef TOYBATCH_H
+#define TOYBATCH_H
+
+// Пакетная точка входа программы, скомпилированной с --batch-entry.
+//
+// toy_batch исполняет программу для count независимых наборов входных
+// данных (дорожек). Массивы хранятся по значениям: k-е вводимое
+// значение дорожки i лежит в inputs[k * count + i], k-е выводимое -
+// в outputs[k * count + i]. В inputs нужно toy_batch_inputs() * count
+// элементов, в outputs - toy_batch_outputs() * count; в counts[i]
+// записывается число значений, выведенных дорожкой i. Массивы inputs,
+// outputs и counts не должны перекрываться: компилятор считает, что
+// запись в один из них не меняет остальные.
+//
+// Переменная, которую дорожка читает до присваивания или ввода, в
+// toy_batch равна нулю. В обычной программе значение такой переменной
+// не определено, поэтому совпадение результатов toy_batch с обычным
+// исполнением гарантируется только для программ без таких чтений.
+//
+// main в таком объектном файле слабый, поэтому его можно компоновать
+// с программой, у которой есть своя main.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Наибольшее число значений, которое программа вводит и выводит.
+int32_t toy_batch_inputs(void);
+int32_t toy_batch_outputs(void);
+
+void toy_batch(const int32_t *inputs, int32_t *outputs, int32_t *counts,
+               int64_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
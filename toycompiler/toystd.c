@@ -1,15 +1,275 @@
 // Стандартная библиотека игрушечного языка
+//
+// Ввод и вывод буферизованы вручную: целые числа разбираются и
+// печатаются без stdio, буфер вывода сбрасывается при заполнении,
+// перед чтением из терминала и при завершении программы.
+//
+// Инструментированная программа (--profile-generate) регистрирует
+// счетчики ветвлений через builtin_profile, и они записываются в файл
+// профиля при завершении.
+//
+// Переменные окружения TOY_BINARY_INPUT=1 и TOY_BINARY_OUTPUT=1
+// включают двоичный формат: каждое число - 4 байта int32 в порядке
+// байтов машины, без разделителей.
 
-#include <stdio.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int32_t builtin_input() {
-  int32_t value = 0;
-  if (scanf("%d", &value) != 1) {
+#define TOY_BUFFER_SIZE (64 * 1024)
+
+// Состояние ввода-вывода - единственный внешний объект данных
+// библиотеки. Программа, разбитая компилятором на части, получает
+// копию функций библиотеки в каждой части, а это состояние у всех
+// частей одно (см. runtime.h в компиляторе).
+struct ToyIo {
+  char InputBuffer[TOY_BUFFER_SIZE];
+  size_t InputPos;
+  size_t InputEnd;
+  int InputEof;
+
+  char OutputBuffer[TOY_BUFFER_SIZE];
+  size_t OutputPos;
+
+  int Initialized;
+  int BinaryInput;
+  int BinaryOutput;
+  int InteractiveOutput;
+};
+
+struct ToyIo toy_io;
+
+void builtin_flush(void) {
+  size_t Done = 0;
+  while (Done < toy_io.OutputPos) {
+    ssize_t Written =
+        write(1, toy_io.OutputBuffer + Done, toy_io.OutputPos - Done);
+    if (Written <= 0) {
+      break;
+    }
+    Done += (size_t)Written;
+  }
+
+  toy_io.OutputPos = 0;
+}
+
+static int EnvFlag(const char *name) {
+  const char *Value = getenv(name);
+  return Value != NULL && strcmp(Value, "1") == 0;
+}
+
+static void Initialize(void) {
+  toy_io.Initialized = 1;
+  toy_io.BinaryInput = EnvFlag("TOY_BINARY_INPUT");
+  toy_io.BinaryOutput = EnvFlag("TOY_BINARY_OUTPUT");
+  toy_io.InteractiveOutput = isatty(1);
+
+  // Данные, напечатанные через stdio, должны попасть в вывод раньше наших.
+  fflush(stdout);
+  atexit(builtin_flush);
+}
+
+// Ввод
+// ====================================================================
+
+// Дочитывание данных в буфер; возвращает 0 в конце ввода.
+static int Refill(void) {
+  if (toy_io.InputEof) {
+    return 0;
+  }
+
+  // Неполная лексема или число переносятся в начало буфера.
+  size_t Rest = toy_io.InputEnd - toy_io.InputPos;
+  memmove(toy_io.InputBuffer, toy_io.InputBuffer + toy_io.InputPos, Rest);
+  toy_io.InputPos = 0;
+  toy_io.InputEnd = Rest;
+
+  // Перед ожиданием ввода пользователь должен увидеть весь вывод.
+  if (toy_io.InteractiveOutput) {
+    builtin_flush();
+  }
+
+  ssize_t Count = read(0, toy_io.InputBuffer + toy_io.InputEnd,
+                       TOY_BUFFER_SIZE - toy_io.InputEnd);
+  if (Count <= 0) {
+    toy_io.InputEof = 1;
     return 0;
   }
 
-  return value;
+  toy_io.InputEnd += (size_t)Count;
+  return 1;
 }
 
-void builtin_print(int32_t value) { printf("%d\n", value); }
+static int PeekChar(void) {
+  if (toy_io.InputPos == toy_io.InputEnd && !Refill()) {
+    return EOF;
+  }
+
+  return (unsigned char)toy_io.InputBuffer[toy_io.InputPos];
+}
+
+// Чтение числа в формате scanf("%d"): пробельные символы пропускаются,
+// допускается знак. Если числа нет, возвращается 0, а первый символ
+// после пробелов и знака остается непрочитанным; знак, как и у scanf,
+// считается прочитанным.
+static int32_t ReadText(void) {
+  int c;
+  while ((c = PeekChar()) == ' ' || c == '\n' || c == '\t' || c == '\r' ||
+         c == '\v' || c == '\f') {
+    ++toy_io.InputPos;
+  }
+
+  int Negative = 0;
+  if (c == '-' || c == '+') {
+    Negative = c == '-';
+    ++toy_io.InputPos;
+    c = PeekChar();
+  }
+
+  if (c < '0' || c > '9') {
+    return 0;
+  }
+
+  uint32_t Value = 0;
+  while ((c = PeekChar()) >= '0' && c <= '9') {
+    Value = Value * 10 + (uint32_t)(c - '0');
+    ++toy_io.InputPos;
+  }
+
+  return (int32_t)(Negative ? 0u - Value : Value);
+}
+
+static int32_t ReadBinary(void) {
+  while (toy_io.InputEnd - toy_io.InputPos < sizeof(int32_t)) {
+    if (!Refill()) {
+      return 0;
+    }
+  }
+
+  int32_t Value;
+  memcpy(&Value, toy_io.InputBuffer + toy_io.InputPos, sizeof(Value));
+  toy_io.InputPos += sizeof(Value);
+  return Value;
+}
+
+int32_t builtin_input() {
+  if (!toy_io.Initialized) {
+    Initialize();
+  }
+
+  return toy_io.BinaryInput ? ReadBinary() : ReadText();
+}
+
+// Вывод
+// ====================================================================
+
+static void WriteText(int32_t value) {
+  // Число с минусом и переводом строки занимает не больше 12 байт.
+  char Digits[12];
+  char *p = Digits + sizeof(Digits);
+  uint32_t Magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+
+  *--p = '\n';
+  do {
+    *--p = (char)('0' + Magnitude % 10);
+    Magnitude /= 10;
+  } while (Magnitude != 0);
+
+  if (value < 0) {
+    *--p = '-';
+  }
+
+  size_t Length = (size_t)(Digits + sizeof(Digits) - p);
+  memcpy(toy_io.OutputBuffer + toy_io.OutputPos, p, Length);
+  toy_io.OutputPos += Length;
+}
+
+void builtin_print(int32_t value) {
+  if (!toy_io.Initialized) {
+    Initialize();
+  }
+
+  if (TOY_BUFFER_SIZE - toy_io.OutputPos < 16) {
+    builtin_flush();
+  }
+
+  if (toy_io.BinaryOutput) {
+    memcpy(toy_io.OutputBuffer + toy_io.OutputPos, &value, sizeof(value));
+    toy_io.OutputPos += sizeof(value);
+  } else {
+    WriteText(value);
+  }
+
+  // В терминал вывод идет построчно, как у stdio.
+  if (toy_io.InteractiveOutput) {
+    builtin_flush();
+  }
+}
+
+// Профиль ветвлений
+// ====================================================================
+
+static uint64_t *ProfileCounters = NULL;
+static uint32_t ProfileBranches = 0;
+static const char *ProfilePath = NULL;
+
+// Прибавление счетчиков из существующего файла профиля, если он
+// записан программой с тем же числом условных операторов.
+static void MergeProfile(void) {
+  FILE *File = fopen(ProfilePath, "r");
+  if (File == NULL) {
+    return;
+  }
+
+  unsigned Branches;
+  size_t Count = 2 * (size_t)ProfileBranches;
+  uint64_t *Old = malloc((Count > 0 ? Count : 1) * sizeof(uint64_t));
+  int Complete = Old != NULL &&
+                 fscanf(File, "toyprofile %u", &Branches) == 1 &&
+                 Branches == ProfileBranches;
+  for (size_t i = 0; Complete && i < Count; ++i) {
+    unsigned long long Value;
+    Complete = fscanf(File, "%llu", &Value) == 1;
+    Old[i] = Value;
+  }
+
+  // Частично прочитанный файл не портит новые счетчики.
+  if (Complete) {
+    for (size_t i = 0; i < Count; ++i) {
+      ProfileCounters[i] += Old[i];
+    }
+  }
+
+  free(Old);
+  fclose(File);
+}
+
+static void WriteProfile(void) {
+  MergeProfile();
+
+  FILE *File = fopen(ProfilePath, "w");
+  if (File == NULL) {
+    perror(ProfilePath);
+    return;
+  }
+
+  fprintf(File, "toyprofile %u\n", (unsigned)ProfileBranches);
+  for (uint32_t i = 0; i < ProfileBranches; ++i) {
+    fprintf(File, "%llu %llu\n", (unsigned long long)ProfileCounters[2 * i],
+            (unsigned long long)ProfileCounters[2 * i + 1]);
+  }
+
+  if (fclose(File) != 0) {
+    perror(ProfilePath);
+  }
+}
+
+void builtin_profile(uint64_t *counters, uint32_t branches,
+                     const char *path) {
+  ProfileCounters = counters;
+  ProfileBranches = branches;
+  ProfilePath = path;
+  atexit(WriteProfile);
+}
@@ -0,0 +1,30 @@
+#ifndef TOYSTD_H
+#define TOYSTD_H
+
+// Стандартная библиотека игрушечного языка (toystd.c).
+// Используется и сгенерированными программами, и самим компилятором
+// при исполнении через интерпретатор байт-кода или JIT.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int32_t builtin_input();
+void builtin_print(int32_t value);
+
+// Сброс буфера вывода. При завершении программы вызывается сам.
+void builtin_flush(void);
+
+// Регистрация счетчиков ветвлений инструментированной программы
+// (см. profile.h в компиляторе): counters[2 * i] и counters[2 * i + 1] -
+// ветви then и else условного оператора i. При завершении программы
+// счетчики записываются в файл path.
+void builtin_profile(uint64_t *counters, uint32_t branches, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif